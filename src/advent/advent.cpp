@@ -0,0 +1,187 @@
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "day1.h"
+#include "day2.h"
+#include "day3.h"
+#include "day4.h"
+#include "day5.h"
+#include "day6.h"
+#include "text_scan.h"
+#include "thread_pool.h"
+
+using part_fn = auto (*)(const char *filename, thread_pool &pool) -> int64_t;
+using both_fn = auto (*)(const char *filename, thread_pool &pool) -> std::pair<int64_t, int64_t>;
+
+/// @brief A day's parts, and for days whose parts share their parsing a
+///        call that answers both from one parse.
+struct day_entry
+{
+    part_fn part1;
+    part_fn part2;
+    both_fn both = nullptr;
+};
+
+/// @brief Every day, day 1 first.
+const std::array<day_entry, 6> DAYS { {
+    { day1::part1, day1::part2, day1::both_parts },
+    { day2::part1, day2::part2 },
+    { day3::part1, day3::part2 },
+    { day4::part1, day4::part2 },
+    { day5::part1, day5::part2, day5::both_parts },
+    { day6::part1, day6::part2 },
+} };
+
+/// @brief One part to run, or with part 0 both parts of a day in one call,
+///        and once it has run, its answers and wall time.
+struct part_run
+{
+    size_t day;
+    size_t part;
+    std::string filename;
+    std::array<int64_t, 2> answers {};
+    double milliseconds = 0;
+};
+
+/// @brief Adds the parts named by @p arg to @p runs: "N" for both parts of
+///        day N, in one call when the day can share its parse between them,
+///        "N.P" for part P alone.
+auto add_selection(std::string_view arg, const std::string &input_dir,
+                   std::vector<part_run> &runs) -> bool
+{
+    const size_t dot = arg.find('.');
+    const auto day = to_int<size_t>(arg.substr(0, dot));
+    const auto part = std::string_view::npos == dot ? 0 : to_int<size_t>(arg.substr(dot + 1));
+    if (day < 1 || day > DAYS.size() || part > 2) return false;
+
+    const std::string filename =
+        (std::filesystem::path(input_dir) / ("day" + std::to_string(day) + ".txt")).string();
+    if (0 == part && nullptr != DAYS[day - 1].both)
+    {
+        runs.push_back({ day, 0, filename });
+        return true;
+    }
+    for (size_t ixPart = 1; ixPart <= 2; ixPart++)
+    {
+        if (0 == part || ixPart == part) runs.push_back({ day, ixPart, filename });
+    }
+    return true;
+}
+
+void run_part(part_run &run, thread_pool &pool)
+{
+    const day_entry &entry = DAYS[run.day - 1];
+    const char *filename = run.filename.c_str();
+    const auto start = std::chrono::steady_clock::now();
+    if (0 == run.part)
+    {
+        const auto [answer1, answer2] = entry.both(filename, pool);
+        run.answers = { answer1, answer2 };
+    }
+    else
+    {
+        run.answers[run.part - 1] = (1 == run.part ? entry.part1 : entry.part2)(filename, pool);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    run.milliseconds = std::chrono::duration<double, std::milli>(elapsed).count();
+}
+
+/// @brief Runs any set of days and parts in one process, sharing one thread
+///        pool and one input cache, and prints each answer with its time.
+///        Both parts from one call print as "dayN.1+2 <part 1> <part 2>".
+///        Without a selection it runs every day whose input exists.
+int main(int argc, char *argv[])
+{
+    // -j N: worker threads, 0 for one per core
+    // -i DIR: directory holding dayN.txt inputs, input by default
+    // -p: run the selected parts side by side on the pool
+    size_t cThreads = 1;
+    std::string input_dir = "input";
+    bool side_by_side = false;
+    while (argc > 1 && '-' == argv[1][0])
+    {
+        const std::string_view option = argv[1];
+        if ("-p" == option)
+        {
+            side_by_side = true;
+            argc -= 1;
+            argv += 1;
+            continue;
+        }
+        if (argc < 3)
+        {
+            std::cout << "Incorrect number of argumnets";
+            return 1;
+        }
+        if ("-j" == option)
+        {
+            cThreads = to_int<size_t>(argv[2]);
+        }
+        else if ("-i" == option)
+        {
+            input_dir = argv[2];
+        }
+        else
+        {
+            std::cout << "Unexpected option";
+            return 1;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    thread_pool pool { cThreads };
+
+    std::vector<part_run> runs {};
+    for (int ixArg = 1; ixArg < argc; ixArg++)
+    {
+        if (!add_selection(argv[ixArg], input_dir, runs))
+        {
+            std::cout << "Unexpected argument";
+            return 1;
+        }
+    }
+    if (1 == argc)
+    {
+        for (size_t day = 1; day <= DAYS.size(); day++)
+        {
+            add_selection(std::to_string(day), input_dir, runs);
+        }
+        std::erase_if(runs, [](const part_run &run)
+            { return !std::filesystem::exists(run.filename); });
+    }
+    if (runs.empty())
+    {
+        std::cout << "No inputs found in " << input_dir;
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    if (side_by_side)
+    {
+        // each part may split its own work on the same pool
+        pool.parallel_for(runs.size(), [&](size_t ix) { run_part(runs[ix], pool); });
+    }
+    else
+    {
+        for (auto &run : runs) run_part(run, pool);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    for (const auto &run : runs)
+    {
+        std::cout << "day" << run.day << '.';
+        if (0 == run.part) std::cout << "1+2 " << run.answers[0] << ' ' << run.answers[1];
+        else std::cout << run.part << ' ' << run.answers[run.part - 1];
+        std::cout << ' ' << run.milliseconds << " ms\n";
+    }
+    std::cout << "total " << std::chrono::duration<double, std::milli>(elapsed).count()
+              << " ms\n";
+    return 0;
+}
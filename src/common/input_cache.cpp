@@ -0,0 +1,26 @@
+#include "input_cache.h"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace
+{
+    std::mutex g_mutex;
+    std::unordered_map<std::string, std::shared_ptr<const mapped_file>> g_files;
+}
+
+auto input_cache::open(const char *filename) -> std::shared_ptr<const mapped_file>
+{
+    {
+        std::lock_guard lock { g_mutex };
+        const auto it = g_files.find(filename);
+        if (g_files.end() != it) return it->second;
+    }
+
+    // mapped outside the lock; if two threads race, the first one in wins
+    auto file = std::make_shared<const mapped_file>(filename);
+    if (!file->is_open()) return file;
+
+    std::lock_guard lock { g_mutex };
+    return g_files.try_emplace(filename, std::move(file)).first->second;
+}
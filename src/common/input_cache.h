@@ -0,0 +1,16 @@
+#pragma once
+#include <memory>
+
+#include "mapped_file.h"
+
+/// @brief Input files mapped once per process and shared by every reader,
+///        so puzzle parts that read the same file, one after another or at
+///        the same time, do not map it again.
+class input_cache
+{
+public:
+    /// @brief The mapping of @p filename, made on first use. A file that
+    ///        cannot be opened maps to an empty view and is not cached, so
+    ///        a later call tries again. Safe to call from any thread.
+    static auto open(const char *filename) -> std::shared_ptr<const mapped_file>;
+};
@@ -0,0 +1,97 @@
+#include "mapped_file.h"
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+mapped_file::mapped_file(const char *filename)
+{
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (INVALID_HANDLE_VALUE == file) return;
+
+    LARGE_INTEGER cBytes {};
+    if (GetFileSizeEx(file, &cBytes) && cBytes.QuadPart > 0)
+    {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY,
+                                            0, 0, nullptr);
+        if (nullptr != mapping)
+        {
+            void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (nullptr != view)
+            {
+                m_data = static_cast<const char *>(view);
+                m_size = static_cast<size_t>(cBytes.QuadPart);
+            }
+            CloseHandle(mapping);
+        }
+    }
+    m_open = nullptr != m_data || 0 == cBytes.QuadPart;
+    CloseHandle(file);
+}
+
+void mapped_file::release()
+{
+    if (nullptr != m_data) UnmapViewOfFile(m_data);
+}
+#else
+mapped_file::mapped_file(const char *filename)
+{
+    const int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st {};
+    if (0 == ::fstat(fd, &st) && st.st_size > 0)
+    {
+        void *view = ::mmap(nullptr, static_cast<size_t>(st.st_size),
+                            PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED != view)
+        {
+            // inputs are consumed front to back exactly once
+            ::madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+            m_data = static_cast<const char *>(view);
+            m_size = static_cast<size_t>(st.st_size);
+        }
+    }
+    m_open = nullptr != m_data || 0 == st.st_size;
+    ::close(fd);
+}
+
+void mapped_file::release()
+{
+    if (nullptr != m_data) ::munmap(const_cast<char *>(m_data), m_size);
+}
+#endif
+
+mapped_file::~mapped_file()
+{
+    release();
+}
+
+mapped_file::mapped_file(mapped_file &&other) noexcept :
+    m_data(std::exchange(other.m_data, nullptr)),
+    m_size(std::exchange(other.m_size, 0)),
+    m_open(std::exchange(other.m_open, false))
+{
+}
+
+mapped_file &mapped_file::operator=(mapped_file &&other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+        m_open = std::exchange(other.m_open, false);
+    }
+    return *this;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+
+/// @brief Read-only memory mapping of an input file.
+///        A file that cannot be opened (or is empty) maps to an empty view,
+///        mirroring the empty results the parsers return for a failed stream.
+class mapped_file
+{
+public:
+    explicit mapped_file(const char *filename);
+    ~mapped_file();
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+    mapped_file(mapped_file &&other) noexcept;
+    mapped_file &operator=(mapped_file &&other) noexcept;
+
+    auto is_open() const -> bool { return m_open; }
+    auto data() const -> const char * { return m_data; }
+    auto size() const -> size_t { return m_size; }
+    auto view() const -> std::string_view { return { m_data, m_size }; }
+
+private:
+    void release();
+
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+    bool m_open = false;
+};
@@ -0,0 +1,132 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+/// @brief Range over the delimiter separated tokens of a view. Tokens are
+///        views into the original text; nothing is copied or allocated.
+///        A trailing '\r' is dropped from each token so CRLF input behaves
+///        the same as LF input.
+class split_range
+{
+public:
+    class iterator
+    {
+    public:
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+        iterator(std::string_view text, char delim, bool skip_empty) :
+            m_rest(text), m_delim(delim), m_skip_empty(skip_empty)
+        {
+            advance();
+        }
+
+        auto operator*() const -> std::string_view { return m_cur; }
+        auto operator++() -> iterator & { advance(); return *this; }
+        auto operator++(int) -> iterator { auto tmp = *this; advance(); return tmp; }
+        auto operator==(std::default_sentinel_t) const -> bool { return m_done; }
+
+    private:
+        void advance()
+        {
+            do
+            {
+                if (m_rest.empty()) { m_done = true; return; }
+                const size_t ixDelim = m_rest.find(m_delim);
+                m_cur = m_rest.substr(0, ixDelim);
+                m_rest.remove_prefix(std::string_view::npos == ixDelim ?
+                                     m_rest.size() : ixDelim + 1);
+                if (!m_cur.empty() && '\r' == m_cur.back()) m_cur.remove_suffix(1);
+            } while (m_skip_empty && m_cur.empty());
+        }
+
+        std::string_view m_rest {};
+        std::string_view m_cur {};
+        char m_delim = '\n';
+        bool m_skip_empty = false;
+        bool m_done = false;
+    };
+
+    split_range(std::string_view text, char delim, bool skip_empty) :
+        m_text(text), m_delim(delim), m_skip_empty(skip_empty) {}
+
+    auto begin() const -> iterator { return { m_text, m_delim, m_skip_empty }; }
+    auto end() const -> std::default_sentinel_t { return {}; }
+
+private:
+    std::string_view m_text;
+    char m_delim;
+    bool m_skip_empty;
+};
+
+/// @brief Lines of @p text, empty lines included.
+inline auto lines(std::string_view text) -> split_range
+{
+    return { text, '\n', false };
+}
+
+/// @brief Non-empty fields of @p text; runs of @p delim are collapsed.
+inline auto fields(std::string_view text, char delim) -> split_range
+{
+    return { text, delim, true };
+}
+
+/// @brief Parses the integer at the front of @p text, skipping any leading
+///        @p skip characters, and advances @p text past it.
+/// @return false if no integer could be read; @p text is left untouched
+template <typename T>
+auto scan_int(std::string_view &text, T &value, char skip = ' ') -> bool
+{
+    size_t ix = 0;
+    while (ix < text.size() && skip == text[ix]) ix++;
+    const char *last = text.data() + text.size();
+    const auto [ptr, ec] = std::from_chars(text.data() + ix, last, value);
+    if (std::errc {} != ec) return false;
+    text.remove_prefix(static_cast<size_t>(ptr - text.data()));
+    return true;
+}
+
+/// @brief Parses @p text as a single integer, 0 if it is not one.
+template <typename T = int>
+auto to_int(std::string_view text) -> T
+{
+    T value {};
+    std::from_chars(text.data(), text.data() + text.size(), value);
+    return value;
+}
+
+/// @brief Rough line count of @p text, extrapolated from its first line.
+///        Used to pre-size containers before a parse.
+inline auto estimate_line_count(std::string_view text) -> size_t
+{
+    if (text.empty()) return 0;
+    const size_t ixEol = text.find('\n');
+    if (std::string_view::npos == ixEol) return 1;
+    return text.size() / (ixEol + 1) + 1;
+}
+
+/// @brief Splits @p text into at most @p cChunks pieces of roughly equal
+///        size, each ending on a line boundary, so every line falls in
+///        exactly one chunk.
+inline auto split_chunks(std::string_view text, size_t cChunks)
+    -> std::vector<std::string_view>
+{
+    std::vector<std::string_view> chunks;
+    chunks.reserve(cChunks);
+    const size_t cTarget = text.size() / std::max<size_t>(cChunks, 1) + 1;
+    while (!text.empty())
+    {
+        size_t ixEnd = std::min(cTarget, text.size());
+        ixEnd = text.find('\n', ixEnd - 1);
+        ixEnd = std::string_view::npos == ixEnd ? text.size() : ixEnd + 1;
+        chunks.emplace_back(text.substr(0, ixEnd));
+        text.remove_prefix(ixEnd);
+    }
+    return chunks;
+}
@@ -0,0 +1,87 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+thread_pool::thread_pool(size_t cThreads)
+{
+    if (0 == cThreads) cThreads = std::max(1u, std::thread::hardware_concurrency());
+    m_workers.reserve(cThreads - 1);
+    for (size_t ix = 1; ix < cThreads; ix++)
+        m_workers.emplace_back([this] { worker_loop(); });
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard lock { m_mutex };
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto &worker : m_workers) worker.join();
+}
+
+void thread_pool::run(size_t cTasks, const std::function<void(size_t)> &task)
+{
+    job j {};
+    j.task = &task;
+    j.cTasks = cTasks;
+    if (cTasks > 1 && !m_workers.empty())
+    {
+        {
+            std::lock_guard lock { m_mutex };
+            m_jobs.push_back(&j);
+        }
+        m_wake.notify_all();
+    }
+
+    work_on(j);
+
+    // every index is claimed; wait for workers still running one of them
+    std::unique_lock lock { m_mutex };
+    std::erase(m_jobs, &j);
+    m_done.wait(lock, [&] { return 0 == j.cActive; });
+    if (j.error) std::rethrow_exception(j.error);
+}
+
+auto thread_pool::claimable_job() -> job *
+{
+    for (job *j : m_jobs)
+    {
+        if (j->next.load(std::memory_order_relaxed) < j->cTasks) return j;
+    }
+    return nullptr;
+}
+
+void thread_pool::worker_loop()
+{
+    std::unique_lock lock { m_mutex };
+    while (true)
+    {
+        job *j = nullptr;
+        m_wake.wait(lock, [&] { return m_stop || nullptr != (j = claimable_job()); });
+        if (m_stop) return;
+
+        j->cActive++;
+        lock.unlock();
+        work_on(*j);
+        lock.lock();
+        j->cActive--;
+        if (0 == j->cActive) m_done.notify_all();
+    }
+}
+
+void thread_pool::work_on(job &j)
+{
+    try
+    {
+        for (size_t ix = j.next++; ix < j.cTasks; ix = j.next++)
+        {
+            (*j.task)(ix);
+        }
+    }
+    catch (...)
+    {
+        // run() rethrows it once no thread can still reach the job
+        if (!j.failed.exchange(true)) j.error = std::current_exception();
+        j.next = j.cTasks;
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/// @brief Fixed set of worker threads running index-parallel jobs.
+///        Each job hands out its task indices from a shared counter, so
+///        uneven tasks balance themselves across the workers. The calling
+///        thread works on its own job too, which keeps nested parallel_for
+///        calls from a task deadlock free.
+class thread_pool
+{
+public:
+    /// @param cThreads - total threads including the caller,
+    ///                   0 for the hardware concurrency
+    explicit thread_pool(size_t cThreads = 0);
+    ~thread_pool();
+
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+
+    auto size() const -> size_t { return m_workers.size() + 1; }
+
+    /// @brief Runs f(ix) for every ix in [0, cTasks) and returns once all
+    ///        of them have finished. If a task throws, no further indices
+    ///        are handed out, and the first exception is rethrown here once
+    ///        every running task has finished.
+    template <typename F>
+    void parallel_for(size_t cTasks, F &&f)
+    {
+        if (0 == cTasks) return;
+        const std::function<void(size_t)> task = [&f](size_t ix) { f(ix); };
+        run(cTasks, task);
+    }
+
+private:
+    struct job
+    {
+        const std::function<void(size_t)> *task = nullptr;
+        size_t cTasks = 0;
+        std::atomic<size_t> next { 0 };
+        size_t cActive = 0; // workers inside work_on, guarded by m_mutex
+        std::atomic<bool> failed { false };
+        std::exception_ptr error; // first exception a task threw
+    };
+
+    void run(size_t cTasks, const std::function<void(size_t)> &task);
+    void worker_loop();
+    auto claimable_job() -> job *;
+    static void work_on(job &j);
+
+    std::vector<std::thread> m_workers;
+    std::vector<job *> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    bool m_stop = false;
+};
+
+/// @brief Sums f(ix) over [0, cTasks) on the pool, one partial per task.
+template <typename T, typename F>
+auto parallel_reduce(thread_pool &pool, size_t cTasks, T init, F &&f) -> T
+{
+    std::vector<T> partials(cTasks, T {});
+    pool.parallel_for(cTasks, [&](size_t ix) { partials[ix] = f(ix); });
+    for (const auto &partial : partials) init += partial;
+    return init;
+}
+
+/// @brief Bounds of task @p ix when [0, count) is split into cTasks
+///        near-equal contiguous ranges.
+inline auto task_range(size_t count, size_t cTasks, size_t ix)
+    -> std::pair<size_t, size_t>
+{
+    return { count * ix / cTasks, count * (ix + 1) / cTasks };
+}
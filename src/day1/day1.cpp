@@ -1,74 +1,475 @@
+#include "day1.h"
 #include <assert.h>
 #include <algorithm>
-#include <charconv>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
-#include <fstream>
-#include <string>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <utility>
 #include <vector>
 
-using list_pair = std::pair<std::vector<int>, std::vector<int>>;
+#include "input_cache.h"
+#include "text_scan.h"
+#include "thread_pool.h"
 
-auto parse_lists(const char *filename) -> list_pair
+namespace day1
 {
-    list_pair ret {};
-    auto &[left, right] = ret;
-    std::ifstream input { filename };
-    for (std::string line; std::getline(input, line);)
-    {
-        size_t ixDelim = line.find_first_of(' ');
-        if (std::string::npos == ixDelim) continue;
 
-        auto &lhs = left.emplace_back(0);
-        auto &rhs = right.emplace_back(0);
-        std::from_chars(line.data(), line.data() + ixDelim, lhs);
-        while ((ixDelim + 1) < line.size() && ' ' == line[++ixDelim]);
-        std::from_chars(line.data() + ixDelim, line.data() + line.size(), rhs);
+struct location_lists
+{
+    std::vector<int> left;
+    std::vector<int> right;
+    // range of every value seen in either list, used to pick a sort backend
+    int min_value = std::numeric_limits<int>::max();
+    int max_value = std::numeric_limits<int>::min();
+};
+
+// largest value span the counting backend will allocate a histogram for
+constexpr uint64_t MAX_HISTOGRAM_SPAN = 1 << 24;
+
+enum class sort_backend
+{
+    counting,
+    radix,
+    comparison
+};
+
+auto parse_chunk(std::string_view text) -> location_lists
+{
+    location_lists ret {};
+    auto &[left, right, min_value, max_value] = ret;
+    const size_t cLines = estimate_line_count(text);
+    left.reserve(cLines);
+    right.reserve(cLines);
+    for (std::string_view line : lines(text))
+    {
+        int lhs {}, rhs {};
+        if (!scan_int(line, lhs) || !scan_int(line, rhs)) continue;
+        left.emplace_back(lhs);
+        right.emplace_back(rhs);
+        min_value = std::min({ min_value, lhs, rhs });
+        max_value = std::max({ max_value, lhs, rhs });
     }
 
     return ret;
 }
 
-auto puzzle1(const char *filename) -> int
+/// @brief Parses newline-aligned chunks of the input on the pool into
+///        per-task lists, then gathers them into one pair of lists.
+auto parse_lists(const char *filename, thread_pool &pool) -> location_lists
+{
+    const auto input = input_cache::open(filename);
+    const auto chunks = split_chunks(input->view(), pool.size());
+    if (chunks.size() <= 1) return parse_chunk(input->view());
+
+    std::vector<location_lists> parts(chunks.size());
+    pool.parallel_for(chunks.size(), [&](size_t ix)
+        {
+            parts[ix] = parse_chunk(chunks[ix]);
+        });
+
+    location_lists ret {};
+    std::vector<size_t> offsets(parts.size() + 1, 0);
+    for (size_t ix = 0; ix < parts.size(); ix++)
+    {
+        offsets[ix + 1] = offsets[ix] + parts[ix].left.size();
+        ret.min_value = std::min(ret.min_value, parts[ix].min_value);
+        ret.max_value = std::max(ret.max_value, parts[ix].max_value);
+    }
+    ret.left.resize(offsets.back());
+    ret.right.resize(offsets.back());
+    pool.parallel_for(parts.size(), [&](size_t ix)
+        {
+            std::copy(parts[ix].left.begin(), parts[ix].left.end(),
+                      ret.left.begin() + offsets[ix]);
+            std::copy(parts[ix].right.begin(), parts[ix].right.end(),
+                      ret.right.begin() + offsets[ix]);
+            parts[ix] = {};
+        });
+    return ret;
+}
+
+auto value_span(const location_lists &lists) -> uint64_t
+{
+    if (lists.left.empty()) return 0;
+    return static_cast<uint64_t>(static_cast<int64_t>(lists.max_value) -
+                                 lists.min_value) + 1;
+}
+
+/// @brief Picks the cheapest sort for the parsed lists.
+///        A histogram wins while it is no larger than the lists themselves
+///        (bounded IDs); radix wins on large lists with wide values; small
+///        lists are not worth the extra passes.
+auto choose_sort_backend(const location_lists &lists) -> sort_backend
+{
+    constexpr size_t MIN_RADIX_COUNT = 1 << 8;
+    const uint64_t span = value_span(lists);
+    const size_t cValues = lists.left.size();
+    if (span <= MAX_HISTOGRAM_SPAN &&
+        span <= 2 * static_cast<uint64_t>(cValues))
+        return sort_backend::counting;
+    if (cValues >= MIN_RADIX_COUNT) return sort_backend::radix;
+    return sort_backend::comparison;
+}
+
+/// @brief Histogram sort of values in [min_value, min_value + span).
+void counting_sort(std::span<int> values, int min_value, uint64_t span)
+{
+    std::vector<uint32_t> histogram(span, 0);
+    for (const int v : values) histogram[static_cast<uint32_t>(v - min_value)]++;
+
+    auto out = values.begin();
+    for (size_t ix = 0; ix < histogram.size(); ix++)
+    {
+        out = std::fill_n(out, histogram[ix], static_cast<int>(min_value + ix));
+    }
+}
+
+/// @brief LSD radix sort on the bias-removed value, one byte per pass and
+///        only as many passes as the value span needs.
+void radix_sort(std::span<int> values, int min_value, uint64_t span)
+{
+    constexpr int RADIX_BITS = 8;
+    constexpr size_t RADIX = 1 << RADIX_BITS;
+    const auto key = [min_value](int v)
+    {
+        return static_cast<uint32_t>(static_cast<int64_t>(v) - min_value);
+    };
+
+    std::vector<int> scratch_buf(values.size());
+    std::span<int> scratch { scratch_buf }, in = values;
+    for (int shift = 0; shift < 32 && (span - 1) >> shift; shift += RADIX_BITS)
+    {
+        std::array<size_t, RADIX> offsets {};
+        for (const int v : in) offsets[(key(v) >> shift) & (RADIX - 1)]++;
+
+        size_t total = 0;
+        for (auto &offset : offsets) total += std::exchange(offset, total);
+
+        for (const int v : in)
+            scratch[offsets[(key(v) >> shift) & (RADIX - 1)]++] = v;
+        std::swap(in, scratch);
+    }
+    if (in.data() != values.data()) std::copy(in.begin(), in.end(), values.begin());
+}
+
+void sort_values(std::span<int> values, sort_backend backend,
+                 int min_value, uint64_t span)
+{
+    switch (backend)
+    {
+    case sort_backend::counting: counting_sort(values, min_value, span); break;
+    case sort_backend::radix:    radix_sort(values, min_value, span);    break;
+    case sort_backend::comparison:
+        std::sort(values.begin(), values.end());
+        break;
+    }
+}
+
+/// @brief Ranges the parallel sort splits @p cValues values into.
+auto sort_range_count(size_t cValues, const thread_pool &pool) -> size_t
+{
+    return std::min(pool.size(), std::max<size_t>(cValues, 1));
+}
+
+/// @brief The backend the parallel sort really runs when asked for
+///        @p backend: counting falls back to radix once the per-range
+///        histograms would outgrow the sequential budget.
+auto parallel_sort_backend(sort_backend backend, uint64_t span, size_t cRanges)
+    -> sort_backend
+{
+    if (sort_backend::counting == backend && span * cRanges > 4 * MAX_HISTOGRAM_SPAN)
+        return sort_backend::radix;
+    return backend;
+}
+
+/// @brief Sorts one range per pool thread, then merges neighbouring ranges
+///        pairwise in parallel rounds.
+void sort_values(std::vector<int> &values, sort_backend backend,
+                 int min_value, uint64_t span, thread_pool &pool)
+{
+    const size_t cRanges = sort_range_count(values.size(), pool);
+    backend = parallel_sort_backend(backend, span, cRanges);
+
+    const auto range_at = [&](size_t ixRange)
+    {
+        return values.begin() + task_range(values.size(), cRanges, ixRange).first;
+    };
+    pool.parallel_for(cRanges, [&](size_t ix)
+        {
+            sort_values({ range_at(ix), range_at(ix + 1) }, backend, min_value, span);
+        });
+
+    for (size_t width = 1; width < cRanges; width *= 2)
+    {
+        const size_t cMerges = (cRanges - width + 2 * width - 1) / (2 * width);
+        pool.parallel_for(cMerges, [&](size_t ix)
+            {
+                const size_t ixFirst = ix * 2 * width;
+                std::inplace_merge(range_at(ixFirst),
+                                   range_at(ixFirst + width),
+                                   range_at(std::min(ixFirst + 2 * width, cRanges)));
+            });
+    }
+}
+
+/// @brief Occurrence count of every value in a list.
+///        Values are counted in a dense array when their span fits the
+///        histogram limit, otherwise in a flat open-addressing table keyed by
+///        value (linear probing, a zero count marks an empty slot).
+class frequency_index
+{
+public:
+    frequency_index(const std::vector<int> &values, int min_value, uint64_t span) :
+        m_min_value(min_value),
+        m_dense(span <= MAX_HISTOGRAM_SPAN &&
+                span <= std::max<uint64_t>(2 * values.size(), 1 << 16))
+    {
+        if (m_dense)
+        {
+            m_counts.assign(span, 0);
+            for (const int v : values) m_counts[key(v)]++;
+            return;
+        }
+
+        size_t capacity = 16;
+        while (capacity < 2 * values.size()) capacity *= 2;
+        m_shift = 64 - std::countr_zero(capacity);
+        m_keys.assign(capacity, 0);
+        m_counts.assign(capacity, 0);
+        for (const int v : values) m_counts[find_slot(v)]++;
+    }
+
+    auto count(int value) const -> uint32_t
+    {
+        if (m_dense)
+        {
+            if (value < m_min_value) return 0;
+            const uint64_t k = key(value);
+            return k < m_counts.size() ? m_counts[k] : 0;
+        }
+        return m_counts[find_slot(value)];
+    }
+
+    auto is_dense() const -> bool { return m_dense; }
+
+    /// @brief Calls @p f(value, count) in ascending value order.
+    ///        Only available on a dense index.
+    template <typename F>
+    void for_each_sorted(F &&f) const
+    {
+        assert(m_dense);
+        for (size_t ix = 0; ix < m_counts.size(); ix++)
+        {
+            if (0 != m_counts[ix]) f(static_cast<int>(m_min_value + ix), m_counts[ix]);
+        }
+    }
+
+private:
+    auto key(int value) const -> uint64_t
+    {
+        return static_cast<uint64_t>(static_cast<int64_t>(value) - m_min_value);
+    }
+
+    auto find_slot(int value) const -> size_t
+    {
+        constexpr uint64_t FIBONACCI_HASH = 0x9E3779B97F4A7C15ull;
+        const size_t mask = m_counts.size() - 1;
+        size_t ix = (static_cast<uint32_t>(value) * FIBONACCI_HASH) >> m_shift;
+        while (0 != m_counts[ix] && value != m_keys[ix]) ix = (ix + 1) & mask;
+        return ix;
+    }
+
+    auto find_slot(int value) -> size_t
+    {
+        const size_t ix = std::as_const(*this).find_slot(value);
+        m_keys[ix] = value;
+        return ix;
+    }
+
+    int m_min_value;
+    bool m_dense;
+    int m_shift = 0;
+    std::vector<int> m_keys;
+    std::vector<uint32_t> m_counts;
+};
+
+/// @brief Sum of distances between the sorted lists. A dense index over
+///        the right list already holds it in sorted order, so only the left
+///        list is sorted then.
+auto sorted_distance(location_lists &lists, sort_backend backend,
+                     thread_pool &pool,
+                     const frequency_index *right_index = nullptr) -> int64_t
 {
-    auto [left_list, right_list] = parse_lists(filename);
-    std::sort(left_list.begin(), left_list.end());
-    std::sort(right_list.begin(), right_list.end());
+    auto &[left_list, right_list, min_value, max_value] = lists;
+    const uint64_t span = value_span(lists);
     assert(left_list.size() == right_list.size());
-    
-    int sum = 0;
-    for (size_t ix = 0; ix < left_list.size(); ix++)
+    sort_values(left_list, backend, min_value, span, pool);
+
+    // the histogram walk is serial, sorting on the pool scales better
+    if (nullptr != right_index && right_index->is_dense() && 1 == pool.size())
     {
-        sum += std::abs(right_list[ix] - left_list[ix]);
+        int64_t sum = 0;
+        size_t ix = 0;
+        right_index->for_each_sorted([&](int value, uint32_t cValue)
+            {
+                for (; cValue > 0; cValue--, ix++)
+                    sum += std::abs(static_cast<int64_t>(value) - left_list[ix]);
+            });
+        return sum;
     }
-    return sum;
+
+    sort_values(right_list, backend, min_value, span, pool);
+    return parallel_reduce(pool, pool.size(), int64_t {}, [&](size_t ixTask)
+        {
+            const auto [first, last] = task_range(left_list.size(), pool.size(), ixTask);
+            int64_t sum = 0;
+            for (size_t ix = first; ix < last; ix++)
+            {
+                sum += std::abs(static_cast<int64_t>(right_list[ix]) - left_list[ix]);
+            }
+            return sum;
+        });
+}
+
+auto similarity_score(const std::vector<int> &left_list,
+                      const frequency_index &right_index,
+                      thread_pool &pool) -> int64_t
+{
+    return parallel_reduce(pool, pool.size(), int64_t {}, [&](size_t ixTask)
+        {
+            const auto [first, last] = task_range(left_list.size(), pool.size(), ixTask);
+            int64_t sum = 0;
+            for (size_t ix = first; ix < last; ix++)
+            {
+                sum += static_cast<int64_t>(left_list[ix]) * right_index.count(left_list[ix]);
+            }
+            return sum;
+        });
+}
+
+auto puzzle1(const char *filename, thread_pool &pool) -> int64_t
+{
+    auto lists = parse_lists(filename, pool);
+    return sorted_distance(lists, choose_sort_backend(lists), pool);
 }
 
-auto puzzle2(const char *filename) -> int
+/// @brief Times every sort backend on the same parsed input.
+auto bench_sort(const char *filename, thread_pool &pool) -> int
 {
-    auto [left_list, right_list] = parse_lists(filename);
-    int sum = 0;
-    for (const auto &lhs : left_list)
+    const auto lists = parse_lists(filename, pool);
+    const sort_backend chosen = choose_sort_backend(lists);
+    constexpr std::pair<sort_backend, const char *> backends[] = {
+        { sort_backend::counting,   "counting"   },
+        { sort_backend::radix,      "radix"      },
+        { sort_backend::comparison, "comparison" },
+    };
+    const auto name_of = [&](sort_backend backend)
     {
-        const auto cNum = std::count(right_list.begin(), right_list.end(), lhs);
-        sum += (lhs * cNum);
+        return std::find_if(std::begin(backends), std::end(backends),
+                            [&](const auto &entry) { return entry.first == backend; })->second;
+    };
+    const size_t cRanges = sort_range_count(lists.left.size(), pool);
+
+    std::cout << lists.left.size() << " pairs, value span "
+              << value_span(lists) << '\n';
+    for (const auto &[backend, name] : backends)
+    {
+        if (sort_backend::counting == backend &&
+            value_span(lists) > MAX_HISTOGRAM_SPAN)
+        {
+            std::cout << name << ": skipped, value span too wide\n";
+            continue;
+        }
+
+        // label the row with the backend that really runs on the pool
+        const sort_backend ran = parallel_sort_backend(backend, value_span(lists), cRanges);
+        auto copy = lists;
+        const auto start = std::chrono::steady_clock::now();
+        const int64_t distance = sorted_distance(copy, backend, pool);
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << name << (chosen == backend ? " (auto)" : "");
+        if (ran != backend) std::cout << " ran as " << name_of(ran);
+        std::cout << ": "
+                  << std::chrono::duration<double, std::milli>(elapsed).count()
+                  << " ms, distance " << distance << '\n';
     }
-    return sum;
+    return 0;
+}
+
+auto puzzle2(const char *filename, thread_pool &pool) -> int64_t
+{
+    const auto lists = parse_lists(filename, pool);
+    const frequency_index right_index { lists.right, lists.min_value,
+                                        value_span(lists) };
+    return similarity_score(lists.left, right_index, pool);
+}
+
+/// @brief Both puzzles off one parse and one index over the right list.
+auto puzzle_both(const char *filename, thread_pool &pool)
+    -> std::pair<int64_t, int64_t>
+{
+    auto lists = parse_lists(filename, pool);
+    const frequency_index right_index { lists.right, lists.min_value,
+                                        value_span(lists) };
+    const int64_t similarity = similarity_score(lists.left, right_index, pool);
+    const int64_t distance =
+        sorted_distance(lists, choose_sort_backend(lists), pool, &right_index);
+    return { distance, similarity };
+}
+
+auto part1(const char *filename, thread_pool &pool) -> int64_t
+{
+    return puzzle1(filename, pool);
+}
+
+auto part2(const char *filename, thread_pool &pool) -> int64_t
+{
+    return puzzle2(filename, pool);
 }
 
-int main(int argc, char *argv[])
+auto both_parts(const char *filename, thread_pool &pool) -> std::pair<int64_t, int64_t>
 {
+    return puzzle_both(filename, pool);
+}
+
+auto run(int argc, char *argv[]) -> int
+{
+    // -j N: worker threads, 0 for one per core
+    size_t cThreads = 1;
+    if (argc > 2 && std::string_view("-j") == argv[1])
+    {
+        cThreads = to_int<size_t>(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
+    thread_pool pool { cThreads };
+
     if (3 != argc)
     {
         std::cout << "Incorrect number of argumnets";
         return 1;
     }
+    else if (std::string_view("bench") == argv[1])
+    {
+        return bench_sort(argv[2], pool);
+    }
+    else if (std::string_view("both") == argv[1])
+    {
+        const auto [distance, similarity] = puzzle_both(argv[2], pool);
+        std::cout << distance << '\n' << similarity;
+    }
     else if ('1' == argv[1][0])
     {
-        std::cout << puzzle1(argv[2]);
+        std::cout << puzzle1(argv[2], pool);
     }
     else if ('2' == argv[1][0])
     {
-        std::cout << puzzle2(argv[2]);
+        std::cout << puzzle2(argv[2], pool);
     }
     else
     {
@@ -77,4 +478,6 @@ int main(int argc, char *argv[])
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+} // namespace day1
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+
+#include "thread_pool.h"
+
+namespace day1
+{
+
+/// @brief Part 1 and part 2 answers for @p filename with the default
+///        options, as the advent driver runs them.
+auto part1(const char *filename, thread_pool &pool) -> int64_t;
+auto part2(const char *filename, thread_pool &pool) -> int64_t;
+
+/// @brief Both answers from a single parse of @p filename.
+auto both_parts(const char *filename, thread_pool &pool) -> std::pair<int64_t, int64_t>;
+
+/// @brief The day1 command line: argv[0] is the program name.
+auto run(int argc, char *argv[]) -> int;
+
+} // namespace day1
@@ -0,0 +1,6 @@
+#include "day1.h"
+
+int main(int argc, char *argv[])
+{
+    return day1::run(argc, argv);
+}
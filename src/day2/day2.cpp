@@ -1,45 +1,86 @@
+#include "day2.h"
 #include "assert.h"
 #include <algorithm>
-#include <charconv>
+#include <array>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
-#include <fstream>
-#include <string>
+#include <limits>
+#include <string_view>
+#include <utility>
 #include <optional>
+#include <span>
+#include <string>
 #include <vector>
 
-using codes = std::vector<std::vector<int>>;
+#include "input_cache.h"
+#include "text_scan.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define DAY2_X86_KERNELS 1
+#include <immintrin.h>
+#else
+#define DAY2_X86_KERNELS 0
+#endif
+
+namespace day2
+{
+
+using code_span = std::span<const int>;
+
+/// @brief All reports in compressed-sparse-row form: the codes of every
+///        report back to back in one array, report ix spanning
+///        [offsets[ix], offsets[ix + 1]).
+struct codes
+{
+    std::vector<int> values;
+    // 32-bit so the batch kernels can load them as lanes; parse_lists
+    // refuses an input with more codes than that
+    std::vector<uint32_t> offsets { 0 };
+
+    auto size() const -> size_t { return offsets.size() - 1; }
+    auto operator[](size_t ix) const -> code_span
+    {
+        return { values.data() + offsets[ix], offsets[ix + 1] - offsets[ix] };
+    }
+
+    struct iterator
+    {
+        const codes *owner;
+        size_t ix;
+        auto operator*() const -> code_span { return (*owner)[ix]; }
+        auto operator++() -> iterator & { ix++; return *this; }
+        auto operator!=(const iterator &other) const -> bool { return ix != other.ix; }
+    };
+    auto begin() const -> iterator { return { this, 0 }; }
+    auto end() const -> iterator { return { this, size() }; }
+};
 
 constexpr char CODE_DELIMITER = ' ';
 
 auto parse_lists(const char *filename) -> codes
 {
     codes ret;
-    const auto emplace = [&](std::vector<int> &code_list,
-                             const std::string &line,
-                             size_t first,
-                             size_t last)
-    {
-        auto& num = code_list.emplace_back(0);
-        std::from_chars(line.data() + first, line.data() + last, num);
-        return line.find_first_of(CODE_DELIMITER, last + 1);
-    };
-
-    std::ifstream input { filename };
-    for (std::string line; std::getline(input, line);)
+    const auto input = input_cache::open(filename);
+    // every code takes at least a digit and a delimiter
+    ret.values.reserve(input->size() / 2);
+    ret.offsets.reserve(estimate_line_count(input->view()) + 1);
+    for (const std::string_view line : lines(input->view()))
     {
-        auto &code_list = ret.emplace_back();
-        size_t ixDelim = line.find_first_of(CODE_DELIMITER), ixOffset = 0;
-        while (ixDelim != std::string::npos)
+        if (line.empty()) continue;
+        for (const std::string_view field : fields(line, CODE_DELIMITER))
         {
-            ixOffset = emplace(code_list, line, ixOffset, ixDelim);
-            std::swap(ixOffset, ixDelim);
-            ixOffset++;
+            ret.values.emplace_back(to_int(field));
         }
-        if (ixOffset < line.size())
+        // the batch kernels load offsets as 32-bit lanes
+        if (ret.values.size() > std::numeric_limits<uint32_t>::max())
         {
-            emplace(code_list, line, ixOffset, line.size());
+            std::cerr << "More than " << std::numeric_limits<uint32_t>::max()
+                      << " codes in " << filename << '\n';
+            return {};
         }
+        ret.offsets.emplace_back(static_cast<uint32_t>(ret.values.size()));
     }
 
     return ret;
@@ -83,53 +124,388 @@ auto codes_are_valid(T begin, T end) -> std::pair<bool, T>
     return std::make_pair(valid, it);
 }
 
-auto puzzle1(const char *filename)
+auto codes_are_valid(code_span code) -> std::pair<bool, code_span::iterator>
 {
-    auto codes = parse_lists(filename);
-    size_t cSafeCodes = 0;
-    for (const auto &code_list : codes)
+    return codes_are_valid(code.begin(), code.end());
+}
+
+enum class validator_kernel
+{
+    scalar,
+    sse41,
+    avx2
+};
+
+auto kernel_name(validator_kernel kernel) -> const char *
+{
+    switch (kernel)
     {
-        const auto [valid, it] =
-            codes_are_valid(code_list.cbegin(), code_list.cend());
-        if (valid) { cSafeCodes++; }
+    case validator_kernel::scalar: return "scalar";
+    case validator_kernel::sse41:  return "sse4.1";
+    case validator_kernel::avx2:   return "avx2";
     }
-    return cSafeCodes;
+    return "";
 }
 
-auto puzzle2(const char *filename)
+auto best_validator_kernel() -> validator_kernel
 {
-    auto codes = parse_lists(filename);
-    size_t cSafeCodes = 0;
-    for (auto &code_list : codes)
+#if DAY2_X86_KERNELS
+    if (__builtin_cpu_supports("avx2")) return validator_kernel::avx2;
+    if (__builtin_cpu_supports("sse4.1")) return validator_kernel::sse41;
+#endif
+    return validator_kernel::scalar;
+}
+
+/// @brief Validity of reports [first, last) through codes_are_valid.
+void validate_scalar(const codes &reports, size_t first, size_t last,
+                     uint8_t *valid)
+{
+    for (size_t ix = first; ix < last; ix++)
+    {
+        const code_span code = reports[ix];
+        valid[ix] = code.size() > 1 && codes_are_valid(code).first;
+    }
+}
+
+#if DAY2_X86_KERNELS
+/// @brief Checks four reports per step, one per 32-bit lane. Each report's
+///        codes are read four at a time with one unaligned load per lane
+///        and transposed with unpacks, so code k of every report lands in
+///        the lanes together; reports shorter than the longest in the batch
+///        mask their missing steps out. The loads run past a short report
+///        into the next one, so a batch whose loads would run past the end
+///        of the values is left to the scalar tail.
+__attribute__((target("sse4.1")))
+void validate_sse41(const codes &reports, size_t first, size_t last,
+                    uint8_t *valid)
+{
+    constexpr size_t LANES = 4;
+    const int *values = reports.values.data();
+    const uint32_t *offsets = reports.offsets.data();
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i max_step = _mm_set1_epi32(4);
+    const __m128i min_step = _mm_set1_epi32(-4);
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t ix = first;
+    for (; ix + LANES <= last; ix += LANES)
+    {
+        const __m128i off = _mm_loadu_si128(reinterpret_cast<const __m128i *>(offsets + ix));
+        const __m128i end = _mm_loadu_si128(reinterpret_cast<const __m128i *>(offsets + ix + 1));
+        const __m128i len = _mm_sub_epi32(end, off);
+        __m128i widest = _mm_max_epu32(len, _mm_shuffle_epi32(len, _MM_SHUFFLE(1, 0, 3, 2)));
+        widest = _mm_max_epu32(widest, _mm_shuffle_epi32(widest, _MM_SHUFFLE(2, 3, 0, 1)));
+        const uint32_t max_len = static_cast<uint32_t>(_mm_cvtsi128_si32(widest));
+        const uint32_t cLoaded = (max_len + LANES - 1) & ~static_cast<uint32_t>(LANES - 1);
+        // the last lane starts furthest in, so its loads end last
+        if (offsets[ix + LANES - 1] + size_t { cLoaded } > reports.values.size()) break;
+
+        const int *rows[LANES] = { values + offsets[ix], values + offsets[ix + 1],
+                                   values + offsets[ix + 2], values + offsets[ix + 3] };
+        __m128i ascending = _mm_set1_epi32(-1), descending = ascending;
+        __m128i prev = zero;
+        for (uint32_t k0 = 0; k0 < max_len; k0 += LANES)
+        {
+            const __m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[0] + k0));
+            const __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[1] + k0));
+            const __m128i r2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[2] + k0));
+            const __m128i r3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[3] + k0));
+            const __m128i lo01 = _mm_unpacklo_epi32(r0, r1), lo23 = _mm_unpacklo_epi32(r2, r3);
+            const __m128i hi01 = _mm_unpackhi_epi32(r0, r1), hi23 = _mm_unpackhi_epi32(r2, r3);
+            const __m128i steps[LANES] = { _mm_unpacklo_epi64(lo01, lo23),
+                                           _mm_unpackhi_epi64(lo01, lo23),
+                                           _mm_unpacklo_epi64(hi01, hi23),
+                                           _mm_unpackhi_epi64(hi01, hi23) };
+
+            // steps at or past max_len are past every report's end and
+            // masked out like any other missing step
+            for (uint32_t j = 0; j < LANES; j++)
+            {
+                const uint32_t k = k0 + j;
+                const __m128i cur = steps[j];
+                if (0 != k)
+                {
+                    const __m128i diff = _mm_sub_epi32(cur, prev);
+                    const __m128i inactive =
+                        _mm_cmpgt_epi32(_mm_set1_epi32(static_cast<int>(k) + 1), len);
+                    const __m128i up = _mm_and_si128(_mm_cmpgt_epi32(diff, zero),
+                                                     _mm_cmpgt_epi32(max_step, diff));
+                    const __m128i down = _mm_and_si128(_mm_cmplt_epi32(diff, zero),
+                                                       _mm_cmpgt_epi32(diff, min_step));
+                    ascending = _mm_and_si128(ascending, _mm_or_si128(up, inactive));
+                    descending = _mm_and_si128(descending, _mm_or_si128(down, inactive));
+                }
+                prev = cur;
+            }
+        }
+
+        const __m128i ok = _mm_and_si128(_mm_or_si128(ascending, descending),
+                                         _mm_cmpgt_epi32(len, one));
+        const int mask = _mm_movemask_ps(_mm_castsi128_ps(ok));
+        for (size_t lane = 0; lane < LANES; lane++) valid[ix + lane] = (mask >> lane) & 1;
+    }
+    validate_scalar(reports, ix, last, valid);
+}
+
+/// @brief Same lane layout as validate_sse41 with eight reports per step;
+///        code k of every lane is fetched with one masked gather.
+__attribute__((target("avx2")))
+void validate_avx2(const codes &reports, size_t first, size_t last,
+                   uint8_t *valid)
+{
+    constexpr size_t LANES = 8;
+    const int *values = reports.values.data();
+    const uint32_t *offsets = reports.offsets.data();
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i max_step = _mm256_set1_epi32(4);
+    const __m256i min_step = _mm256_set1_epi32(-4);
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t ix = first;
+    for (; ix + LANES <= last; ix += LANES)
+    {
+        const __m256i off = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(offsets + ix));
+        const __m256i end = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(offsets + ix + 1));
+        const __m256i len = _mm256_sub_epi32(end, off);
+        uint32_t max_len = 0;
+        for (size_t lane = 0; lane < LANES; lane++)
+            max_len = std::max(max_len, offsets[ix + lane + 1] - offsets[ix + lane]);
+
+        const __m256i all = _mm256_set1_epi32(-1);
+        __m256i ascending = all, descending = all;
+        __m256i prev = _mm256_mask_i32gather_epi32(zero, values, off,
+                                                   _mm256_cmpgt_epi32(len, zero), 4);
+        __m256i ixCode = off;
+        for (uint32_t k = 1; k < max_len; k++)
+        {
+            ixCode = _mm256_add_epi32(ixCode, one);
+            const __m256i present =
+                _mm256_cmpgt_epi32(len, _mm256_set1_epi32(static_cast<int>(k)));
+            const __m256i cur =
+                _mm256_mask_i32gather_epi32(zero, values, ixCode, present, 4);
+            const __m256i diff = _mm256_sub_epi32(cur, prev);
+            const __m256i up = _mm256_and_si256(_mm256_cmpgt_epi32(diff, zero),
+                                                _mm256_cmpgt_epi32(max_step, diff));
+            const __m256i down = _mm256_and_si256(_mm256_cmpgt_epi32(zero, diff),
+                                                  _mm256_cmpgt_epi32(diff, min_step));
+            const __m256i absent = _mm256_andnot_si256(present, all);
+            ascending = _mm256_and_si256(ascending, _mm256_or_si256(up, absent));
+            descending = _mm256_and_si256(descending, _mm256_or_si256(down, absent));
+            prev = cur;
+        }
+
+        const __m256i ok = _mm256_and_si256(_mm256_or_si256(ascending, descending),
+                                            _mm256_cmpgt_epi32(len, one));
+        const int mask = _mm256_movemask_ps(_mm256_castsi256_ps(ok));
+        for (size_t lane = 0; lane < LANES; lane++) valid[ix + lane] = (mask >> lane) & 1;
+    }
+    validate_scalar(reports, ix, last, valid);
+}
+#endif
+
+/// @brief Validity flag of every report, computed with @p kernel.
+auto validate_reports(const codes &reports, validator_kernel kernel)
+    -> std::vector<uint8_t>
+{
+    std::vector<uint8_t> valid(reports.size(), 0);
+    // gather indices are 32-bit signed
+    if (reports.values.size() > static_cast<size_t>(INT32_MAX))
+        kernel = validator_kernel::scalar;
+
+    switch (kernel)
     {
-        auto [valid, it] = codes_are_valid(code_list.begin(), code_list.end());
-        if (valid) { cSafeCodes++; continue; }
-        // Encountered unsafe list, check if within tolerance
+#if DAY2_X86_KERNELS
+    case validator_kernel::avx2:
+        validate_avx2(reports, 0, reports.size(), valid.data());
+        break;
+    case validator_kernel::sse41:
+        validate_sse41(reports, 0, reports.size(), valid.data());
+        break;
+#endif
+    default:
+        validate_scalar(reports, 0, reports.size(), valid.data());
+        break;
+    }
+    return valid;
+}
 
-        // Beginning may have different direction than end
-        auto valid_it = codes_are_valid(code_list.begin() + 1, code_list.end());
-        if (valid_it.first) { cSafeCodes++; continue;}
+/// @brief Mismatches of every batch kernel this CPU supports against the
+///        scalar codes_are_valid template on @p reports, with their times.
+/// @return the total number of mismatches
+auto compare_kernels(const codes &reports, std::string_view label) -> size_t
+{
+    const auto expected = validate_reports(reports, validator_kernel::scalar);
+    const validator_kernel best = best_validator_kernel();
+    size_t cMismatchTotal = 0;
+    for (const auto kernel : { validator_kernel::scalar, validator_kernel::sse41,
+                               validator_kernel::avx2 })
+    {
+        if (kernel > best) continue;
+        const auto start = std::chrono::steady_clock::now();
+        const auto valid = validate_reports(reports, kernel);
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        size_t cMismatch = 0;
+        for (size_t ix = 0; ix < valid.size(); ix++)
+            cMismatch += valid[ix] != expected[ix];
+        std::cout << label << ' ' << kernel_name(kernel) << ": " << cMismatch
+                  << " mismatches in " << valid.size() << " reports, "
+                  << std::chrono::duration<double, std::milli>(elapsed).count() << " ms\n";
+        cMismatchTotal += cMismatch;
+    }
+    return cMismatchTotal;
+}
 
-        const int erased_val = *it;
-        const size_t ix = std::distance(code_list.begin(), it - 1);
-        code_list.erase(it);
-        valid_it = codes_are_valid(code_list.begin(), code_list.end());
-        if (valid_it.first) { cSafeCodes++; continue; }
+/// @brief Reports that probe the edges of the batch kernels: empty and
+///        one-code reports, lengths on either side of a 4-code load, and
+///        report counts on either side of the 4- and 8-lane batch sizes.
+///        Most reports are valid runs; some break a step on purpose.
+auto edge_case_reports() -> std::vector<codes>
+{
+    constexpr size_t MAX_REPORTS = 19;
+    constexpr size_t MAX_LENGTH = 10;
+    std::vector<codes> ret(MAX_REPORTS + 1);
+    for (size_t cReports = 0; cReports <= MAX_REPORTS; cReports++)
+    {
+        codes &reports = ret[cReports];
+        for (size_t ixReport = 0; ixReport < cReports; ixReport++)
+        {
+            const size_t cCodes = (ixReport * 5 + cReports) % (MAX_LENGTH + 1);
+            const int direction = 0 == ixReport % 2 ? 1 : -1;
+            int code = 50 + static_cast<int>(ixReport);
+            for (size_t k = 0; k < cCodes; k++)
+            {
+                reports.values.emplace_back(code);
+                // steps of 1 to 3, with a flat or too long step now and then
+                const size_t pick = (ixReport * 3 + k * 7 + cReports) % 11;
+                code += direction * (0 == pick ? 0 : 1 == pick ? 4 : 1 + static_cast<int>(pick % 3));
+            }
+            reports.offsets.emplace_back(static_cast<uint32_t>(reports.values.size()));
+        }
+    }
+    return ret;
+}
+
+/// @brief Differential check of every batch kernel this CPU supports
+///        against the scalar codes_are_valid template, on generated edge
+///        cases and then on @p filename.
+auto verify_kernels(const char *filename) -> int
+{
+    size_t cMismatch = 0;
+    const auto edge_cases = edge_case_reports();
+    for (size_t ix = 0; ix < edge_cases.size(); ix++)
+        cMismatch += compare_kernels(edge_cases[ix], "edge" + std::to_string(ix));
+    cMismatch += compare_kernels(parse_lists(filename), filename);
+    return 0 == cMismatch ? 0 : 1;
+}
+
+auto puzzle1(const char *filename)
+{
+    const auto codes = parse_lists(filename);
+    const auto valid = validate_reports(codes, best_validator_kernel());
+    return static_cast<size_t>(std::count(valid.begin(), valid.end(), 1));
+}
+
+/// @brief Streaming "problem dampener" check: is the report valid with at
+///        most one code removed? Codes are pushed one at a time and only the
+///        last two are kept, so a report never has to be buffered.
+///        For each direction three prefix states are tracked:
+///          kept_all    - the prefix is valid with nothing removed
+///          kept_last   - one earlier code was removed, the newest is kept
+///          dropped_last - the newest code is removed, the rest kept
+///        Like codes_are_valid, a report needs at least two codes left.
+class dampened_report
+{
+public:
+    void push(int value)
+    {
+        for (size_t ixDir = 0; ixDir < m_states.size(); ixDir++)
+        {
+            auto &state = m_states[ixDir];
+            const bool ascending = 0 == ixDir;
+            if (0 == m_count)
+            {
+                state = { true, false, true };
+                continue;
+            }
 
-        code_list[ix] = erased_val;
-        valid_it = codes_are_valid(code_list.begin(), code_list.end());
-        if (valid_it.first) { cSafeCodes++; continue; }
+            const bool step_ok = is_step(m_prev, value, ascending);
+            const bool skip_ok = 1 == m_count || is_step(m_prev2, value, ascending);
+            state = {
+                state.kept_all && step_ok,
+                (state.kept_last && step_ok) || (state.dropped_last && skip_ok),
+                state.kept_all
+            };
+        }
+        m_prev2 = std::exchange(m_prev, value);
+        m_count++;
+    }
+
+    auto is_valid() const -> bool
+    {
+        return std::any_of(m_states.begin(), m_states.end(), [&](const auto &state)
+            {
+                return (m_count >= 2 && state.kept_all) ||
+                       (m_count >= 3 && (state.kept_last || state.dropped_last));
+            });
+    }
+
+private:
+    struct prefix_state
+    {
+        bool kept_all = true;
+        bool kept_last = false;
+        bool dropped_last = true;
+    };
+
+    static auto is_step(int from, int to, bool ascending) -> bool
+    {
+        constexpr int64_t MAX_VAL = 4;
+        const int64_t diff = ascending ? int64_t { to } - from : int64_t { from } - to;
+        return diff > 0 && diff < MAX_VAL;
+    }
+
+    std::array<prefix_state, 2> m_states {};
+    int m_prev = 0;
+    int m_prev2 = 0;
+    size_t m_count = 0;
+};
+
+/// @brief Streams the reports straight off the mapped input; no report is
+///        stored, copied or erased.
+auto puzzle2(const char *filename)
+{
+    const auto input = input_cache::open(filename);
+    size_t cSafeCodes = 0;
+    for (std::string_view line : lines(input->view()))
+    {
+        dampened_report report;
+        for (int code; scan_int(line, code, CODE_DELIMITER);) report.push(code);
+        cSafeCodes += report.is_valid();
     }
     return cSafeCodes;
 }
 
-int main(int argc, char *argv[])
+auto part1(const char *filename, thread_pool &) -> int64_t
+{
+    return static_cast<int64_t>(puzzle1(filename));
+}
+
+auto part2(const char *filename, thread_pool &) -> int64_t
+{
+    return static_cast<int64_t>(puzzle2(filename));
+}
+
+auto run(int argc, char *argv[]) -> int
 {
     if (3 != argc)
     {
         std::cout << "Incorrect number of argumnets";
         return 1;
     }
+    else if (std::string_view("verify") == argv[1])
+    {
+        return verify_kernels(argv[2]);
+    }
     else if ('1' == argv[1][0])
     {
         std::cout << puzzle1(argv[2]);
@@ -146,3 +522,5 @@ int main(int argc, char *argv[])
 
     return 0;
 }
+
+} // namespace day2
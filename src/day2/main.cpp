@@ -0,0 +1,6 @@
+#include "day2.h"
+
+int main(int argc, char *argv[])
+{
+    return day2::run(argc, argv);
+}
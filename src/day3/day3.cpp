@@ -1,86 +1,540 @@
+#include "day3.h"
 #include "assert.h"
+#include <algorithm>
+#include <array>
 #include <charconv>
-#include <fstream>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <optional>
 #include <regex>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
 
-auto parse_file(const char *filename) -> std::string
+#include "input_cache.h"
+#include "mapped_file.h"
+#include "text_scan.h"
+#include "thread_pool.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define DAY3_X86_PREFILTER 1
+#include <immintrin.h>
+#else
+#define DAY3_X86_PREFILTER 0
+#endif
+
+namespace day3
 {
-    std::ifstream input_file { filename };
-    if (input_file.fail()) return "";
-    input_file.seekg(0, std::ios_base::end);
-    const size_t cBytes = input_file.tellg();
-    std::string buf(cBytes, ' ');
-    input_file.seekg(0);
-    input_file.read(&buf[0], cBytes);
-    return buf;
+
+auto parse_file(const char *filename) -> std::shared_ptr<const mapped_file>
+{
+    return input_cache::open(filename);
 }
 
-auto multiply_strings(const std::string &str1, const std::string &str2) -> int
+auto submatch_view(const std::csub_match &sub) -> std::string_view
 {
-    int mul_1 {}, mul_2 {};
-    std::from_chars(str1.data(), str1.data() + str1.size(), mul_1);
-    std::from_chars(str2.data(), str2.data() + str2.size(), mul_2);
-    return mul_1 * mul_2;
+    return { sub.first, static_cast<size_t>(sub.length()) };
 }
 
-auto puzzle1(const char *filename) -> int 
+auto multiply_strings(std::string_view str1, std::string_view str2) -> int64_t
 {
-    int res {};
-    std::string code = parse_file(filename);
-    std::regex mul { "mul\\(([0-9]+),([0-9]+)\\)" };
-    auto begin = std::sregex_iterator(code.begin(), code.end(), mul);
-    auto end = std::sregex_iterator();
-    for (std::sregex_iterator it = begin; it != end; ++it)
-    {
-        const std::smatch &match = *it;
-        assert(3 == match.size());
-        res += multiply_strings(match.str(1), match.str(2));
-    }
-    return res;
+    return int64_t { to_int(str1) } * to_int(str2);
 }
 
-auto puzzle2(const char *filename) -> int
+/// @brief Reference engine: std::regex over the whole buffer.
+auto scan_regex(std::string_view code, bool honor_toggles) -> int64_t
 {
-    int res {};
-    std::string code = parse_file(filename);
-    std::regex mul { "mul\\(([0-9]+),([0-9]+)\\)|do\\(\\)|don't\\(\\)" };
-    auto begin = std::sregex_iterator(code.begin(), code.end(), mul);
-    auto end = std::sregex_iterator();
-    std::string mul_str;
-    const std::string enable = "do()";
-    const std::string disable = "don't()";
+    int64_t res {};
+    const std::regex mul { honor_toggles ?
+        "mul\\(([0-9]+),([0-9]+)\\)|do\\(\\)|don't\\(\\)" :
+        "mul\\(([0-9]+),([0-9]+)\\)" };
+    auto begin = std::cregex_iterator(code.data(), code.data() + code.size(), mul);
+    auto end = std::cregex_iterator();
+    constexpr std::string_view enable = "do()";
+    constexpr std::string_view disable = "don't()";
     bool enabled = true;
-    for (std::sregex_iterator it = begin; it != end; ++it)
+    for (std::cregex_iterator it = begin; it != end; ++it)
     {
-        const std::smatch &match = *it;
-        mul_str = match.str();
+        const std::cmatch &match = *it;
+        const std::string_view mul_str = submatch_view(match[0]);
         if (enable == mul_str) enabled = true;
         else if (disable == mul_str) enabled = false;
         else if (enabled)
         {
             assert(3 == match.size());
-            res += multiply_strings(match.str(1), match.str(2));
+            res += multiply_strings(submatch_view(match[1]),
+                                    submatch_view(match[2]));
         }
     }
     return res;
 }
 
-int main(int argc, char *argv[])
+enum class scan_state : uint8_t
+{
+    idle,
+    m, mu, mul, mul_open, lhs, comma, rhs, mul_close,
+    d, do_, do_open, do_close,
+    don, don_apos, don_t, dont_open, dont_close,
+    STATE_COUNT
+};
+
+using scan_transitions = std::array<std::array<scan_state, 256>,
+                                    static_cast<size_t>(scan_state::STATE_COUNT)>;
+
+/// @brief Transition table of the instruction DFA. Any character without
+///        an explicit edge falls back to what it would do from idle.
+constexpr auto build_scan_transitions() -> scan_transitions
 {
+    using enum scan_state;
+    scan_transitions table {};
+    for (auto &row : table)
+    {
+        for (size_t c = 0; c < row.size(); c++)
+            row[c] = 'm' == c ? m : 'd' == c ? d : idle;
+    }
+
+    const auto on = [&](scan_state from, char c, scan_state to)
+    {
+        table[static_cast<size_t>(from)][static_cast<uint8_t>(c)] = to;
+    };
+    on(m, 'u', mu);
+    on(mu, 'l', mul);
+    on(mul, '(', mul_open);
+    on(lhs, ',', comma);
+    on(rhs, ')', mul_close);
+    for (char c = '0'; c <= '9'; c++)
+    {
+        on(mul_open, c, lhs);
+        on(lhs, c, lhs);
+        on(comma, c, rhs);
+        on(rhs, c, rhs);
+    }
+    on(d, 'o', do_);
+    on(do_, '(', do_open);
+    on(do_open, ')', do_close);
+    on(do_, 'n', don);
+    on(don, '\'', don_apos);
+    on(don_apos, 't', don_t);
+    on(don_t, '(', dont_open);
+    on(dont_open, ')', dont_close);
+    return table;
+}
+
+constexpr scan_transitions SCAN_TRANSITIONS = build_scan_transitions();
+
+/// @brief First byte in [first, last) that can start a token ('m' or 'd'),
+///        last if there is none.
+auto find_candidate_scalar(const char *first, const char *last) -> const char *
+{
+    for (; first < last; first++)
+    {
+        if ('m' == *first || 'd' == *first) return first;
+    }
+    return last;
+}
+
+#if DAY3_X86_PREFILTER
+__attribute__((target("sse2")))
+auto find_candidate_sse2(const char *first, const char *last) -> const char *
+{
+    const __m128i m = _mm_set1_epi8('m');
+    const __m128i d = _mm_set1_epi8('d');
+    for (; first + 16 <= last; first += 16)
+    {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+        const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(bytes, m),
+                                                        _mm_cmpeq_epi8(bytes, d)));
+        if (0 != mask) return first + __builtin_ctz(static_cast<unsigned>(mask));
+    }
+    return find_candidate_scalar(first, last);
+}
+
+__attribute__((target("avx2")))
+auto find_candidate_avx2(const char *first, const char *last) -> const char *
+{
+    const __m256i m = _mm256_set1_epi8('m');
+    const __m256i d = _mm256_set1_epi8('d');
+    for (; first + 32 <= last; first += 32)
+    {
+        const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+        const int mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, m),
+                                                              _mm256_cmpeq_epi8(bytes, d)));
+        if (0 != mask) return first + __builtin_ctz(static_cast<unsigned>(mask));
+    }
+    return find_candidate_sse2(first, last);
+}
+#endif
+
+using find_candidate_fn = auto (*)(const char *, const char *) -> const char *;
+
+/// @brief Widest candidate search this CPU supports, picked once.
+auto candidate_finder() -> find_candidate_fn
+{
+#if DAY3_X86_PREFILTER
+    static const find_candidate_fn finder =
+        __builtin_cpu_supports("avx2") ? find_candidate_avx2 : find_candidate_sse2;
+    return finder;
+#else
+    return find_candidate_scalar;
+#endif
+}
+
+/// @brief Streaming recogniser for mul(a,b), do() and don't().
+///        A DFA over a transition table built at compile time; the state,
+///        the operands read so far and the enabled flag carry over between
+///        feed() calls, so input can arrive in chunks of any size and
+///        memory stays constant.
+///        No character inside a partial token can start another token, so
+///        on a mismatch the offending character is simply re-read from the
+///        idle state; this matches the leftmost matches of the regex.
+///        The same property means a token's match depends only on the text
+///        from its first byte on, which is what lets chunks of a file be
+///        scanned independently (see scan_chunk).
+class instruction_scanner
+{
+public:
+    explicit instruction_scanner(bool honor_toggles) :
+        m_honor_toggles(honor_toggles) {}
+
+    void feed(std::string_view chunk)
+    {
+        for (const char c : chunk) step(c);
+    }
+
+    /// @brief Same result as feed(), but while no token is in progress the
+    ///        bytes up to the next 'm' or 'd' are skipped with a vectorized
+    ///        search instead of being stepped through the DFA. From idle
+    ///        (or a just-accepted token) every other byte leads back to
+    ///        idle, so skipping them is exact.
+    void feed_prefiltered(std::string_view chunk)
+    {
+        const find_candidate_fn find_candidate = candidate_finder();
+        const char *it = chunk.data();
+        const char *last = it + chunk.size();
+        while (it < last)
+        {
+            if (is_resting())
+            {
+                it = find_candidate(it, last);
+                if (it == last) break;
+            }
+            step(*it++);
+        }
+    }
+
+    /// @brief Steps on into the text past a chunk's end only to finish a
+    ///        token that started inside the chunk. Stops once no token is
+    ///        in progress or at the next 'm'/'d', which starts a token the
+    ///        following chunk owns.
+    void finish_token(std::string_view rest)
+    {
+        for (const char c : rest)
+        {
+            if (is_resting() || 'm' == c || 'd' == c) break;
+            step(c);
+        }
+    }
+
+    /// @brief Sum for a scan that started enabled.
+    auto sum() const -> int64_t { return m_sum_untoggled + m_sum; }
+
+    /// @brief Sum for a scan that started disabled.
+    auto sum_if_disabled() const -> int64_t { return m_sum; }
+
+    /// @brief Enabled state left by the last do()/don't(), if any was seen.
+    auto final_toggle() const -> std::optional<bool>
+    {
+        if (!m_seen_toggle) return std::nullopt;
+        return m_enabled;
+    }
+
+private:
+    // operands past int range read as 0, as from_chars leaves them
+    static constexpr int64_t OPERAND_LIMIT =
+        int64_t { std::numeric_limits<int>::max() } + 1;
+
+    auto is_resting() const -> bool
+    {
+        using enum scan_state;
+        return idle == m_state || mul_close == m_state ||
+               do_close == m_state || dont_close == m_state;
+    }
+
+    void step(char c)
+    {
+        using enum scan_state;
+        m_state = SCAN_TRANSITIONS[static_cast<size_t>(m_state)][static_cast<uint8_t>(c)];
+        switch (m_state)
+        {
+        case mul_open: m_lhs = 0; break;
+        case comma:    m_rhs = 0; break;
+        case lhs:      m_lhs = accumulate(m_lhs, c); break;
+        case rhs:      m_rhs = accumulate(m_rhs, c); break;
+        case mul_close:
+            if (m_lhs >= OPERAND_LIMIT || m_rhs >= OPERAND_LIMIT) break;
+            if (!m_seen_toggle) m_sum_untoggled += m_lhs * m_rhs;
+            else if (m_enabled) m_sum += m_lhs * m_rhs;
+            break;
+        case do_close:
+        case dont_close:
+            if (!m_honor_toggles) break;
+            m_seen_toggle = true;
+            m_enabled = do_close == m_state;
+            break;
+        default: break;
+        }
+    }
+
+    static auto accumulate(int64_t value, char digit) -> int64_t
+    {
+        return std::min(value * 10 + (digit - '0'), OPERAND_LIMIT);
+    }
+
+    bool m_honor_toggles;
+    // products before the first toggle count only if the scan started
+    // enabled; after it the toggles decide
+    bool m_seen_toggle = false;
+    bool m_enabled = true;
+    scan_state m_state = scan_state::idle;
+    int64_t m_lhs = 0;
+    int64_t m_rhs = 0;
+    int64_t m_sum_untoggled = 0;
+    int64_t m_sum = 0;
+};
+
+enum class scan_engine
+{
+    regex,
+    dfa,
+    prefilter
+};
+
+constexpr std::pair<scan_engine, std::string_view> SCAN_ENGINES[] = {
+    { scan_engine::regex,     "regex"     },
+    { scan_engine::dfa,       "dfa"       },
+    { scan_engine::prefilter, "prefilter" },
+};
+
+void feed_scanner(instruction_scanner &scanner, std::string_view chunk,
+                  scan_engine engine)
+{
+    if (scan_engine::prefilter == engine) scanner.feed_prefiltered(chunk);
+    else scanner.feed(chunk);
+}
+
+/// @brief What a chunk contributes for either enabled state it may be
+///        entered in, and the state it leaves behind.
+struct chunk_summary
+{
+    int64_t sum_if_enabled = 0;
+    int64_t sum_if_disabled = 0;
+    std::optional<bool> final_toggle;
+};
+
+/// @brief Scans the tokens that start in code[first, last). A token that
+///        starts inside but straddles the end is finished from the bytes
+///        past it; one straddling the start belongs to the previous chunk
+///        and its tail bytes lead the idle DFA nowhere.
+auto scan_chunk(std::string_view code, size_t first, size_t last,
+                bool honor_toggles, scan_engine engine) -> chunk_summary
+{
+    instruction_scanner scanner { honor_toggles };
+    feed_scanner(scanner, code.substr(first, last - first), engine);
+    scanner.finish_token(code.substr(last));
+    return { scanner.sum(), scanner.sum_if_disabled(), scanner.final_toggle() };
+}
+
+/// @brief Scans fixed-size chunks on the pool, then threads the enabled
+///        state through the chunk summaries in order.
+auto scan_view(std::string_view code, bool honor_toggles, scan_engine engine,
+               thread_pool &pool) -> int64_t
+{
+    if (scan_engine::regex == engine) return scan_regex(code, honor_toggles);
+
+    // a few chunks per thread so a slow chunk does not hold up the rest
+    constexpr size_t CHUNKS_PER_THREAD = 4;
+    constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+    const size_t cChunks = 1 == pool.size() ? 1 :
+        std::clamp<size_t>(code.size() / MIN_CHUNK_SIZE, 1,
+                           pool.size() * CHUNKS_PER_THREAD);
+
+    std::vector<chunk_summary> summaries(cChunks);
+    pool.parallel_for(cChunks, [&](size_t ix)
+        {
+            const auto [first, last] = task_range(code.size(), cChunks, ix);
+            summaries[ix] = scan_chunk(code, first, last, honor_toggles, engine);
+        });
+
+    int64_t sum = 0;
+    bool enabled = true;
+    for (const auto &summary : summaries)
+    {
+        sum += enabled ? summary.sum_if_enabled : summary.sum_if_disabled;
+        enabled = summary.final_toggle.value_or(enabled);
+    }
+    return sum;
+}
+
+/// @brief Runs the chosen engine over a file. The streaming engines also
+///        read stdin in fixed-size chunks when the file name is "-".
+auto scan_file(const char *filename, bool honor_toggles, scan_engine engine,
+               thread_pool &pool) -> int64_t
+{
+    if (scan_engine::regex != engine && std::string_view("-") == filename)
+    {
+        instruction_scanner scanner { honor_toggles };
+        constexpr size_t CHUNK_SIZE = 1 << 16;
+        std::vector<char> chunk(CHUNK_SIZE);
+        while (std::cin.read(chunk.data(), chunk.size()) || std::cin.gcount() > 0)
+        {
+            feed_scanner(scanner,
+                         { chunk.data(), static_cast<size_t>(std::cin.gcount()) },
+                         engine);
+        }
+        return scanner.sum();
+    }
+
+    const auto code = parse_file(filename);
+    return scan_view(code->view(), honor_toggles, engine, pool);
+}
+
+/// @brief Deterministic corrupted-memory noise of @p cBytes bytes with
+///        real and broken instructions sprinkled in.
+auto synthetic_input(size_t cBytes) -> std::string
+{
+    constexpr std::string_view noise = "abcefghijklnopqrstuvwxyz#@!^&*[]{}<>;:?+-_ ()',";
+    constexpr std::string_view tokens[] = {
+        "mul(", "mul(12,34)", "mul(7,808)", "do()", "don't()", "mul[3,7]", "mul ( 2,4)",
+    };
+    std::string ret;
+    ret.reserve(cBytes);
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    while (ret.size() < cBytes)
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        const uint32_t r = static_cast<uint32_t>(state >> 33);
+        if (0 == r % 24) ret.append(tokens[(r >> 8) % std::size(tokens)]);
+        else ret.push_back(noise[(r >> 8) % noise.size()]);
+    }
+    ret.resize(cBytes);
+    return ret;
+}
+
+/// @brief Times every engine on both puzzles over a file, or over
+///        synthetic input when the argument is a size in MiB.
+auto bench_engines(const char *source, thread_pool &pool) -> int
+{
+    std::string synthetic;
+    std::optional<mapped_file> file;
+    std::string_view code;
+    const std::string_view source_view = source;
+    size_t cMebibytes = 0;
+    const auto [ptr, ec] = std::from_chars(source_view.data(),
+                                           source_view.data() + source_view.size(),
+                                           cMebibytes);
+    if (std::errc {} == ec && ptr == source_view.data() + source_view.size())
+    {
+        synthetic = synthetic_input(cMebibytes << 20);
+        code = synthetic;
+    }
+    else
+    {
+        file.emplace(source);
+        code = file->view();
+    }
+
+    std::cout << code.size() << " bytes, " << pool.size() << " threads\n";
+    for (const auto &[engine, name] : SCAN_ENGINES)
+    {
+        for (const bool honor_toggles : { false, true })
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const int64_t sum = scan_view(code, honor_toggles, engine, pool);
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            const double seconds = std::chrono::duration<double>(elapsed).count();
+            std::cout << name << " puzzle" << (honor_toggles ? 2 : 1) << ": "
+                      << seconds * 1000 << " ms, "
+                      << code.size() / seconds / (1 << 20) << " MiB/s, sum "
+                      << sum << '\n';
+        }
+    }
+    return 0;
+}
+
+auto puzzle1(const char *filename, scan_engine engine, thread_pool &pool) -> int64_t
+{
+    return scan_file(filename, false, engine, pool);
+}
+
+auto puzzle2(const char *filename, scan_engine engine, thread_pool &pool) -> int64_t
+{
+    return scan_file(filename, true, engine, pool);
+}
+
+auto part1(const char *filename, thread_pool &pool) -> int64_t
+{
+    return puzzle1(filename, scan_engine::prefilter, pool);
+}
+
+auto part2(const char *filename, thread_pool &pool) -> int64_t
+{
+    return puzzle2(filename, scan_engine::prefilter, pool);
+}
+
+auto run(int argc, char *argv[]) -> int
+{
+    // -e regex|dfa|prefilter: scanning engine, the prefiltered DFA by default
+    // -j N: worker threads, 0 for one per core
+    scan_engine engine = scan_engine::prefilter;
+    size_t cThreads = 1;
+    while (argc > 3 && '-' == argv[1][0])
+    {
+        const std::string_view option = argv[1];
+        if ("-e" == option)
+        {
+            const auto it = std::find_if(std::begin(SCAN_ENGINES), std::end(SCAN_ENGINES),
+                [&](const auto &entry) { return entry.second == argv[2]; });
+            if (std::end(SCAN_ENGINES) == it)
+            {
+                std::cout << "Unexpected engine";
+                return 1;
+            }
+            engine = it->first;
+        }
+        else if ("-j" == option)
+        {
+            cThreads = to_int<size_t>(argv[2]);
+        }
+        else
+        {
+            std::cout << "Unexpected option";
+            return 1;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    thread_pool pool { cThreads };
+
     if (3 != argc)
     {
         std::cout << "Incorrect number of argumnets";
         return 1;
     }
+    else if (std::string_view("bench") == argv[1])
+    {
+        return bench_engines(argv[2], pool);
+    }
     else if ('1' == argv[1][0])
     {
-        std::cout << puzzle1(argv[2]);
+        std::cout << puzzle1(argv[2], engine, pool);
     }
     else if ('2' == argv[1][0])
     {
-        std::cout << puzzle2(argv[2]);
+        std::cout << puzzle2(argv[2], engine, pool);
     }
     else
     {
@@ -89,4 +543,6 @@ int main(int argc, char *argv[])
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+} // namespace day3
@@ -0,0 +1,6 @@
+#include "day3.h"
+
+int main(int argc, char *argv[])
+{
+    return day3::run(argc, argv);
+}
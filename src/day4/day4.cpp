@@ -1,110 +1,462 @@
+#include "day4.h"
 #include "assert.h"
 #include <algorithm>
 #include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
-#include <fstream>
-#include <numeric>
-#include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
-using grid = std::vector<std::string>;
-static const std::string TARGET_WORD = "XMAS";
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
-auto parse_file(const char *filename) -> grid
+#include "grid.h"
+#include "grid_search.h"
+#include "input_cache.h"
+#include "mapped_file.h"
+#include "text_scan.h"
+#include "thread_pool.h"
+
+namespace day4
 {
-    std::ifstream input_file(filename);
-    if (input_file.fail()) { return {}; }
-    std::vector<std::string> ret {};
-    for (std::string line; std::getline(input_file, line); )
-        ret.emplace_back(std::move(line));
-    return ret;
+
+static constexpr std::string_view TARGET_WORD = "XMAS";
+/// @brief Rows a band reads beyond its own so every match anchored in it
+///        is still seen whole.
+static constexpr size_t HALO_ROWS = TARGET_WORD.size() - 1;
+
+auto parse_file(const mapped_file &input) -> grid
+{
+    return parse_grid(input, TARGET_WORD.size());
+}
+
+/// @brief The eight neighbour offsets of a cell in a grid of @p stride.
+auto direction_strides(ptrdiff_t stride) -> std::array<ptrdiff_t, 8>
+{
+    return { 1, -1, stride, -stride,
+             stride + 1, stride - 1, -stride + 1, -stride - 1 };
+}
+
+auto check_target(const char *cell, const std::array<ptrdiff_t, 8> &strides) -> int
+{
+    if (*cell != TARGET_WORD[0]) return 0;
+
+    int sum = 0;
+    for (const ptrdiff_t step : strides)
+    {
+        bool match = true;
+        for (size_t ixChar = 1; ixChar < TARGET_WORD.size(); ixChar++)
+        {
+            match &= TARGET_WORD[ixChar] == cell[static_cast<ptrdiff_t>(ixChar) * step];
+        }
+        sum += static_cast<int>(match);
+    }
+    return sum;
 }
 
-auto check_target(const grid &g, size_t ixRow, size_t ixCol) -> int
+/// @brief One bit per cell for each letter of an alphabet, 64 columns to a
+///        word. Bit c of a row's words is column c. Each row carries a zero
+///        guard word on both sides so a shifted read never leaves it.
+///        Matching a word along any direction is then an AND of shifted
+///        planes followed by a popcount, 64 cells at a time.
+class letter_planes
 {
-    assert(ixRow < g.size());
-    assert(ixCol < g[ixRow].size());
-    assert(TARGET_WORD.size() > 0);
+public:
+    static constexpr uint8_t NO_LETTER = 0xFF;
 
-    if (g[ixRow][ixCol] != TARGET_WORD[0]) return 0;
+    letter_planes(const grid &g, std::string_view alphabet) :
+        letter_planes(g, alphabet, 0, g.rows())
+    {
+    }
 
-    size_t ixRowAhead = ixRow, ixRowBehind = ixRow;
-    size_t ixColAhead = ixCol, ixColBehind = ixCol;
-    std::array<int, 8> count { 0, 0, 0, 0, 0, 0, 0, 0 };
-    for (size_t ixChar = 0; ixChar < TARGET_WORD.size(); ixChar++)
+    /// @brief Planes of rows [firstRow, lastRow) of @p g only; plane row 0
+    ///        is grid row firstRow.
+    letter_planes(const grid &g, std::string_view alphabet, size_t firstRow, size_t lastRow) :
+        m_rows(lastRow - firstRow),
+        m_words((g.cols() + 63) / 64),
+        m_row_stride(m_words + 2),
+        m_planes(alphabet.size(), std::vector<uint64_t>(m_rows * m_row_stride, 0))
     {
-        const char c = TARGET_WORD[ixChar];
-        count[0] += static_cast<int>(c == g[ixRow][ixColAhead]);
-        count[1] += static_cast<int>(c == g[ixRow][ixColBehind]);
-        count[2] += static_cast<int>(c == g[ixRowAhead][ixCol]);
-        count[3] += static_cast<int>(c == g[ixRowBehind][ixCol]);
-        if (ixCol < g[ixRow].size() - 3 && ixRow < g.size() - 3)
-            count[4] += static_cast<int>(c == g[ixRowAhead][ixColAhead]);
-        if (ixCol >= 3 && ixRow < g.size() - 3)
-            count[5] += static_cast<int>(c == g[ixRowAhead][ixColBehind]);
-        if (ixCol < g[ixRow].size() - 3 && ixRow >= 3)
-            count[6] += static_cast<int>(c == g[ixRowBehind][ixColAhead]);
-        if (ixCol >= 3 && ixRow >= 3)
-            count[7] += static_cast<int>(c == g[ixRowBehind][ixColBehind]);
+        m_letter_of.fill(NO_LETTER);
+        for (size_t ix = 0; ix < alphabet.size(); ix++)
+            m_letter_of[static_cast<uint8_t>(alphabet[ix])] = static_cast<uint8_t>(ix);
 
-        ixRowAhead = std::max<size_t>(ixRowAhead, ixRowAhead + 1);
-        ixColAhead = std::max<size_t>(ixColAhead, ixColAhead + 1);
-        ixRowBehind = std::min<size_t>(ixRowBehind, ixRowBehind - 1);
-        ixColBehind = std::min<size_t>(ixColBehind, ixColBehind - 1);
-        if (ixRowAhead >= g.size()) ixRowAhead = g.size() - 1;
-        if (ixColAhead >= g[ixRow].size()) ixColAhead = g[ixRow].size() - 1;
+        for (size_t ixRow = 0; ixRow < m_rows; ixRow++)
+        {
+            const char *row = g.cell(firstRow + ixRow, 0);
+            for (size_t ixWord = 0; ixWord < m_words; ixWord++)
+            {
+                // the last block of a row is copied out so the read stays
+                // inside the buffer whatever the padding
+                const size_t cCells = std::min<size_t>(64, g.cols() - ixWord * 64);
+                alignas(16) char block[64] {};
+                std::copy_n(row + ixWord * 64, cCells, block);
+                for (size_t ixLetter = 0; ixLetter < alphabet.size(); ixLetter++)
+                {
+                    m_planes[ixLetter][ixRow * m_row_stride + 1 + ixWord] =
+                        match_mask(block, alphabet[ixLetter]);
+                }
+            }
+        }
     }
 
-    int sum = 0;
-    for (const auto c : count) sum += static_cast<int>(c == TARGET_WORD.size());
-    return sum;
+    auto rows() const -> size_t { return m_rows; }
+    auto words() const -> size_t { return m_words; }
+    auto letter_of(char c) const -> uint8_t { return m_letter_of[static_cast<uint8_t>(c)]; }
+
+    /// @brief Word @p ixWord of @p letter's row, read @p shift columns to the
+    ///        right (negative: left), so bit c holds column c + shift.
+    ///        |shift| must be below 64.
+    auto shifted(uint8_t letter, size_t ixRow, size_t ixWord, int shift) const -> uint64_t
+    {
+        const uint64_t *w = m_planes[letter].data() + ixRow * m_row_stride + 1 + ixWord;
+        if (0 == shift) return w[0];
+        if (shift > 0) return (w[0] >> shift) | (w[1] << (64 - shift));
+        return (w[0] << -shift) | (w[-1] >> (64 + shift));
+    }
+
+private:
+    /// @brief Bit i set where block[i] == c.
+    static auto match_mask(const char *block, char c) -> uint64_t
+    {
+        uint64_t mask = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+        const __m128i needle = _mm_set1_epi8(c);
+        for (int ix = 0; ix < 4; ix++)
+        {
+            const __m128i bytes = _mm_load_si128(reinterpret_cast<const __m128i *>(block) + ix);
+            const uint32_t bits = static_cast<uint32_t>(
+                _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, needle)));
+            mask |= uint64_t { bits } << (16 * ix);
+        }
+#else
+        for (int ix = 0; ix < 64; ix++) mask |= uint64_t { block[ix] == c } << ix;
+#endif
+        return mask;
+    }
+
+    size_t m_rows;
+    size_t m_words;
+    size_t m_row_stride;
+    std::vector<std::vector<uint64_t>> m_planes;
+    std::array<uint8_t, 256> m_letter_of {};
+};
+
+/// @brief Occurrences of @p word starting on rows [firstRow, lastRow) and
+///        running in direction (dRow, dCol).
+auto count_word(const letter_planes &planes, std::string_view word,
+                int dRow, int dCol, size_t firstRow, size_t lastRow) -> int
+{
+    const ptrdiff_t reach = static_cast<ptrdiff_t>(word.size() - 1) * dRow;
+    // rows where the whole word stays on the grid
+    const ptrdiff_t minRow = std::max<ptrdiff_t>(static_cast<ptrdiff_t>(firstRow), -reach);
+    const ptrdiff_t maxRow = std::min<ptrdiff_t>(static_cast<ptrdiff_t>(lastRow),
+                                                 static_cast<ptrdiff_t>(planes.rows()) - std::max<ptrdiff_t>(reach, 0));
+    std::vector<uint8_t> letters(word.size());
+    for (size_t ixChar = 0; ixChar < word.size(); ixChar++)
+    {
+        letters[ixChar] = planes.letter_of(word[ixChar]);
+        if (letter_planes::NO_LETTER == letters[ixChar]) return 0;
+    }
+
+    int ret = 0;
+    for (ptrdiff_t ixRow = minRow; ixRow < maxRow; ixRow++)
+    {
+        for (size_t ixWord = 0; ixWord < planes.words(); ixWord++)
+        {
+            uint64_t match = ~uint64_t { 0 };
+            for (size_t ixChar = 0; ixChar < word.size(); ixChar++)
+            {
+                const int offset = static_cast<int>(ixChar);
+                match &= planes.shifted(letters[ixChar],
+                                        static_cast<size_t>(ixRow + offset * dRow),
+                                        ixWord, offset * dCol);
+            }
+            ret += std::popcount(match);
+        }
+    }
+    return ret;
+}
+
+constexpr std::array<std::pair<int, int>, 8> DIRECTIONS = { {
+    { 0, 1 }, { 0, -1 }, { 1, 0 }, { -1, 0 },
+    { 1, 1 }, { 1, -1 }, { -1, 1 }, { -1, -1 },
+} };
+
+auto count_target_bitplanes(const letter_planes &planes, size_t firstRow, size_t lastRow) -> int
+{
+    int ret = 0;
+    for (const auto &[dRow, dCol] : DIRECTIONS)
+        ret += count_word(planes, TARGET_WORD, dRow, dCol, firstRow, lastRow);
+    return ret;
 }
 
-auto puzzle1(const char *filename) -> int
+/// @brief X-MAS centres on rows [firstRow, lastRow): an 'A' whose two
+///        diagonals each read "MAS" one way or the other.
+auto count_cross_bitplanes(const letter_planes &planes, size_t firstRow, size_t lastRow) -> int
+{
+    const uint8_t m = planes.letter_of('M');
+    const uint8_t a = planes.letter_of('A');
+    const uint8_t s = planes.letter_of('S');
+    int ret = 0;
+    for (size_t ixRow = std::max<size_t>(firstRow, 1);
+         ixRow < std::min(lastRow, planes.rows() - 1) && planes.rows() > 2; ixRow++)
+    {
+        for (size_t ixWord = 0; ixWord < planes.words(); ixWord++)
+        {
+            const auto at = [&](uint8_t letter, int dRow, int dCol)
+            {
+                return planes.shifted(letter, ixRow + dRow, ixWord, dCol);
+            };
+            const uint64_t falling = (at(m, -1, -1) & at(s, 1, 1)) |
+                                     (at(s, -1, -1) & at(m, 1, 1));
+            const uint64_t rising = (at(m, 1, -1) & at(s, -1, 1)) |
+                                    (at(s, 1, -1) & at(m, -1, 1));
+            ret += std::popcount(at(a, 0, 0) & falling & rising);
+        }
+    }
+    return ret;
+}
+
+enum class search_kernel
+{
+    scalar,
+    bitplane,
+    engine
+};
+
+auto count_target_scalar(const grid &g, size_t firstRow, size_t lastRow) -> int
 {
     int ret {};
-    const grid g = parse_file(filename);
-    // invariant: each row has the same number of columns
-    for (size_t ixRow = 0; ixRow < g.size(); ixRow++)
+    const auto strides = direction_strides(g.stride());
+    for (size_t ixRow = firstRow; ixRow < lastRow; ixRow++)
     {
-        for (size_t ixCol = 0; ixCol < g[ixRow].size(); ixCol++)
+        const char *row = g.cell(ixRow, 0);
+        for (size_t ixCol = 0; ixCol < g.cols(); ixCol++)
         {
-            ret += check_target(g, ixRow, ixCol);
+            ret += check_target(row + ixCol, strides);
         }
     }
     return ret;
 }
 
-auto puzzle2(const char *filename) -> int
+auto count_cross_scalar(const grid &g, size_t firstRow, size_t lastRow) -> int
 {
     int ret {};
-    const grid g = parse_file(filename);
-    // invariant: each row has the same number of columns
-    const size_t last_row = g.size() - 1;
-    const size_t last_col = g[0].size() - 1;
-    for (size_t ixRow = 1; ixRow < last_row; ixRow++)
+    const ptrdiff_t down = g.stride();
+    for (size_t ixRow = firstRow; ixRow < lastRow; ixRow++)
     {
-        for (size_t ixCol = 0; ixCol < last_col; ixCol++)
+        const char *row = g.cell(ixRow, 0);
+        for (size_t ixCol = 0; ixCol < g.cols(); ixCol++)
         {
-            if (g[ixRow][ixCol] != 'A') continue;
+            const char *c = row + ixCol;
+            if (*c != 'A') continue;
 
             int legs = 0;
-            legs += g[ixRow - 1][ixCol - 1] == 'M' &&
-                    g[ixRow + 1][ixCol + 1] == 'S';
-            legs += g[ixRow - 1][ixCol - 1] == 'S' &&
-                    g[ixRow + 1][ixCol + 1] == 'M';
-            legs += g[ixRow + 1][ixCol - 1] == 'M' &&
-                    g[ixRow - 1][ixCol + 1] == 'S';
-            legs += g[ixRow + 1][ixCol - 1] == 'S' &&
-                    g[ixRow - 1][ixCol + 1] == 'M';
+            legs += c[-down - 1] == 'M' && c[down + 1] == 'S';
+            legs += c[-down - 1] == 'S' && c[down + 1] == 'M';
+            legs += c[down - 1] == 'M' && c[-down + 1] == 'S';
+            legs += c[down - 1] == 'S' && c[-down + 1] == 'M';
             ret += (2 == legs);
         }
     }
     return ret;
 }
 
-int main(int argc, char *argv[])
+/// @brief The four rotations of the X-MAS stencil.
+constexpr std::array<std::array<std::string_view, 3>, 4> CROSS_STENCILS = { {
+    { "M.S", ".A.", "M.S" },
+    { "M.M", ".A.", "S.S" },
+    { "S.M", ".A.", "S.M" },
+    { "S.S", ".A.", "M.M" },
+} };
+
+auto target_search() -> grid_search
 {
+    grid_search search {};
+    search.add_word(TARGET_WORD);
+    search.build();
+    return search;
+}
+
+auto cross_search() -> grid_search
+{
+    grid_search search {};
+    for (const auto &stencil : CROSS_STENCILS)
+        search.add_stencil({ stencil.begin(), stencil.end() });
+    search.build();
+    return search;
+}
+
+auto count_engine(const grid_search &search, const grid &g, size_t firstRow, size_t lastRow) -> int
+{
+    int64_t ret = 0;
+    for (const int64_t count : search.search(g, firstRow, lastRow)) ret += count;
+    return static_cast<int>(ret);
+}
+
+/// @brief Rows [first, last) of a band and the rows [haloFirst, haloLast)
+///        it may read: HALO_ROWS more on each side, clipped to the grid.
+struct band
+{
+    size_t haloFirst;
+    size_t first;
+    size_t last;
+    size_t haloLast;
+};
+
+/// @brief Sums count(band) over horizontal bands of @p g on the pool. A
+///        band only counts matches anchored on its own rows and reads its
+///        halo for the rest, so a match across a band edge is counted once.
+///        Each band returns its own partial; nothing is shared while
+///        counting.
+template <typename F>
+auto count_bands(const grid &g, thread_pool &pool, F &&count) -> int
+{
+    // a few bands per thread so uneven bands balance out, but not so thin
+    // that the halo rows outweigh the band
+    constexpr size_t BANDS_PER_THREAD = 4;
+    constexpr size_t MIN_BAND_ROWS = 8 * HALO_ROWS;
+    const size_t cBands = 1 == pool.size() ? 1 :
+        std::clamp<size_t>(g.rows() / MIN_BAND_ROWS, 1, pool.size() * BANDS_PER_THREAD);
+
+    return parallel_reduce(pool, cBands, 0, [&](size_t ix)
+        {
+            const auto [first, last] = task_range(g.rows(), cBands, ix);
+            return count(band { first - std::min(first, HALO_ROWS), first, last,
+                                std::min(g.rows(), last + HALO_ROWS) });
+        });
+}
+
+auto puzzle1(const char *filename, search_kernel kernel, thread_pool &pool) -> int
+{
+    const auto input = input_cache::open(filename);
+    const grid g = parse_file(*input);
+    if (search_kernel::scalar == kernel)
+    {
+        return count_bands(g, pool, [&](const band &b)
+            { return count_target_scalar(g, b.first, b.last); });
+    }
+    if (search_kernel::engine == kernel)
+    {
+        const grid_search search = target_search();
+        return count_bands(g, pool, [&](const band &b)
+            { return count_engine(search, g, b.first, b.last); });
+    }
+    return count_bands(g, pool, [&](const band &b)
+        {
+            const letter_planes planes { g, TARGET_WORD, b.haloFirst, b.haloLast };
+            return count_target_bitplanes(planes, b.first - b.haloFirst, b.last - b.haloFirst);
+        });
+}
+
+auto puzzle2(const char *filename, search_kernel kernel, thread_pool &pool) -> int
+{
+    const auto input = input_cache::open(filename);
+    const grid g = parse_file(*input);
+    if (search_kernel::scalar == kernel)
+    {
+        return count_bands(g, pool, [&](const band &b)
+            { return count_cross_scalar(g, b.first, b.last); });
+    }
+    if (search_kernel::engine == kernel)
+    {
+        const grid_search search = cross_search();
+        return count_bands(g, pool, [&](const band &b)
+            { return count_engine(search, g, b.first, b.last); });
+    }
+    return count_bands(g, pool, [&](const band &b)
+        {
+            const letter_planes planes { g, "MAS", b.haloFirst, b.haloLast };
+            return count_cross_bitplanes(planes, b.first - b.haloFirst, b.last - b.haloFirst);
+        });
+}
+
+/// @brief Counts every pattern of @p patterns_filename in the grid, one
+///        pattern per line: a word, found in all eight directions, or a
+///        stencil given as '/'-separated rows with '.' matching any cell.
+void search_patterns(const char *grid_filename, const char *patterns_filename)
+{
+    const mapped_file input { grid_filename };
+    const mapped_file patterns_input { patterns_filename };
+    const grid g = parse_grid(input, 0);
+
+    grid_search search {};
+    std::vector<std::string_view> patterns {};
+    for (const std::string_view line : lines(patterns_input.view()))
+    {
+        if (line.empty()) continue;
+        patterns.emplace_back(line);
+        if (std::string_view::npos == line.find('/'))
+        {
+            search.add_word(line);
+            continue;
+        }
+        std::vector<std::string_view> rows {};
+        for (const std::string_view row : fields(line, '/')) rows.emplace_back(row);
+        search.add_stencil(rows);
+    }
+    search.build();
+
+    const auto counts = search.search(g);
+    for (size_t ix = 0; ix < patterns.size(); ix++)
+        std::cout << patterns[ix] << ' ' << counts[ix] << '\n';
+}
+
+auto part1(const char *filename, thread_pool &pool) -> int64_t
+{
+    return puzzle1(filename, search_kernel::bitplane, pool);
+}
+
+auto part2(const char *filename, thread_pool &pool) -> int64_t
+{
+    return puzzle2(filename, search_kernel::bitplane, pool);
+}
+
+auto run(int argc, char *argv[]) -> int
+{
+    // -k scalar|bitplane|engine: search kernel, bitplanes by default
+    // -j N: worker threads, 0 for one per core
+    search_kernel kernel = search_kernel::bitplane;
+    size_t cThreads = 1;
+    while (argc > 3 && '-' == argv[1][0])
+    {
+        const std::string_view option = argv[1];
+        const std::string_view value = argv[2];
+        if ("-k" == option)
+        {
+            if ("scalar" == value) kernel = search_kernel::scalar;
+            else if ("engine" == value) kernel = search_kernel::engine;
+            else if ("bitplane" != value)
+            {
+                std::cout << "Unexpected kernel";
+                return 1;
+            }
+        }
+        else if ("-j" == option)
+        {
+            cThreads = to_int<size_t>(value);
+        }
+        else
+        {
+            std::cout << "Unexpected option";
+            return 1;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    thread_pool pool { cThreads };
+
+    if (4 == argc && std::string_view("search") == argv[1])
+    {
+        search_patterns(argv[2], argv[3]);
+        return 0;
+    }
+
     if (3 != argc)
     {
         std::cout << "Incorrect number of argumnets";
@@ -112,11 +464,11 @@ int main(int argc, char *argv[])
     }
     else if ('1' == argv[1][0])
     {
-        std::cout << puzzle1(argv[2]) << '\n';
+        std::cout << puzzle1(argv[2], kernel, pool) << '\n';
     }
     else if ('2' == argv[1][0])
     {
-        std::cout << puzzle2(argv[2]) << '\n';
+        std::cout << puzzle2(argv[2], kernel, pool) << '\n';
     }
     else
     {
@@ -126,3 +478,5 @@ int main(int argc, char *argv[])
 
     return 0;
 }
+
+} // namespace day4
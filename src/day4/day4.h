@@ -0,0 +1,17 @@
+#pragma once
+#include <cstdint>
+
+#include "thread_pool.h"
+
+namespace day4
+{
+
+/// @brief Part 1 and part 2 answers for @p filename with the default
+///        options, as the advent driver runs them.
+auto part1(const char *filename, thread_pool &pool) -> int64_t;
+auto part2(const char *filename, thread_pool &pool) -> int64_t;
+
+/// @brief The day4 command line: argv[0] is the program name.
+auto run(int argc, char *argv[]) -> int;
+
+} // namespace day4
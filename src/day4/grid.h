@@ -0,0 +1,68 @@
+#pragma once
+#include "assert.h"
+#include <algorithm>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.h"
+#include "text_scan.h"
+
+/// @brief A word search in one contiguous buffer, surrounded by a border
+///        of sentinel cells @p pad wide. A walk of up to pad steps in any
+///        direction from a real cell stays inside the buffer, so neighbours
+///        are plain pointer offsets with no bounds checks.
+class grid
+{
+public:
+    static constexpr char SENTINEL = '\0';
+
+    grid() = default;
+    grid(const std::vector<std::string_view> &rows, size_t cCols, size_t pad) :
+        m_rows(rows.size()),
+        m_cols(cCols),
+        m_pad(pad),
+        m_stride(cCols + 2 * pad),
+        m_cells((rows.size() + 2 * pad) * m_stride, SENTINEL)
+    {
+        for (size_t ixRow = 0; ixRow < rows.size(); ixRow++)
+        {
+            std::copy(rows[ixRow].begin(), rows[ixRow].end(),
+                      m_cells.begin() + (ixRow + pad) * m_stride + pad);
+        }
+    }
+
+    auto rows() const -> size_t { return m_rows; }
+    auto cols() const -> size_t { return m_cols; }
+    auto pad() const -> size_t { return m_pad; }
+    auto stride() const -> ptrdiff_t { return static_cast<ptrdiff_t>(m_stride); }
+
+    /// @brief Pointer to cell (ixRow, ixCol); valid from -pad to size + pad.
+    auto cell(size_t ixRow, size_t ixCol) const -> const char *
+    {
+        assert(ixRow < m_rows && ixCol < m_cols);
+        return m_cells.data() + (ixRow + m_pad) * m_stride + ixCol + m_pad;
+    }
+
+private:
+    size_t m_rows = 0;
+    size_t m_cols = 0;
+    size_t m_pad = 0;
+    size_t m_stride = 0;
+    std::vector<char> m_cells;
+};
+
+inline auto parse_grid(const mapped_file &input, size_t pad) -> grid
+{
+    // row views only live for the copy into the padded buffer
+    std::vector<std::string_view> rows {};
+    rows.reserve(estimate_line_count(input.view()));
+    size_t cCols = 0;
+    for (const std::string_view line : lines(input.view()))
+    {
+        if (line.empty()) continue;
+        rows.emplace_back(line);
+        cCols = std::max(cCols, line.size());
+    }
+    return grid { rows, cCols, pad };
+}
@@ -0,0 +1,199 @@
+#include "grid_search.h"
+#include <algorithm>
+
+void aho_corasick::add(std::string_view word, uint32_t id)
+{
+    m_pending.emplace_back(word, id);
+}
+
+auto aho_corasick::add_state() -> uint32_t
+{
+    m_next.resize(m_next.size() + m_cSymbols, 0);
+    m_fail.emplace_back(0);
+    m_ids.emplace_back();
+    return static_cast<uint32_t>(m_fail.size() - 1);
+}
+
+void aho_corasick::build()
+{
+    m_symbol_of.fill(0);
+    m_cSymbols = 1;
+    for (const auto &[word, id] : m_pending)
+    {
+        for (const char c : word)
+        {
+            auto &symbol = m_symbol_of[static_cast<uint8_t>(c)];
+            if (0 == symbol) symbol = static_cast<uint8_t>(m_cSymbols++);
+        }
+    }
+
+    // trie; 0 doubles as "no edge" since no edge leads back to the root
+    m_next.clear();
+    m_fail.clear();
+    m_ids.clear();
+    add_state();
+    for (const auto &[word, id] : m_pending)
+    {
+        uint32_t state = 0;
+        for (const char c : word)
+        {
+            const size_t ixEdge = state * m_cSymbols + m_symbol_of[static_cast<uint8_t>(c)];
+            if (0 == m_next[ixEdge])
+            {
+                const uint32_t child = add_state();
+                m_next[ixEdge] = child;
+            }
+            state = m_next[ixEdge];
+        }
+        m_ids[state].emplace_back(id);
+    }
+
+    // breadth first: fill missing edges from the failure state, which is
+    // always shallower and so already complete; a state's own row is
+    // untouched until it is dequeued, so a nonzero edge there is a child
+    m_bfs_order.clear();
+    m_bfs_order.emplace_back(0);
+    for (size_t ixQueue = 0; ixQueue < m_bfs_order.size(); ixQueue++)
+    {
+        const uint32_t state = m_bfs_order[ixQueue];
+        for (size_t symbol = 1; symbol < m_cSymbols; symbol++)
+        {
+            uint32_t &edge = m_next[state * m_cSymbols + symbol];
+            const uint32_t fallback = 0 == state ? 0 : m_next[m_fail[state] * m_cSymbols + symbol];
+            if (0 == edge)
+            {
+                edge = fallback;
+                continue;
+            }
+            m_fail[edge] = fallback;
+            m_bfs_order.emplace_back(edge);
+        }
+    }
+    m_pending.clear();
+}
+
+void aho_corasick::collect(std::vector<uint64_t> &hits, std::vector<int64_t> &counts) const
+{
+    // deepest first, so a state's visits reach its whole suffix chain
+    for (auto it = m_bfs_order.rbegin(); it != m_bfs_order.rend(); ++it)
+    {
+        const uint32_t state = *it;
+        if (0 == hits[state]) continue;
+        for (const uint32_t id : m_ids[state]) counts[id] += static_cast<int64_t>(hits[state]);
+        if (0 != state) hits[m_fail[state]] += hits[state];
+    }
+}
+
+auto grid_search::add_word(std::string_view word) -> size_t
+{
+    const auto id = static_cast<uint32_t>(m_cPatterns++);
+    if (word.empty()) return id;
+    m_longest_word = std::max(m_longest_word, word.size());
+    // the reverse read along a line is the word read the opposite way;
+    // a palindrome lands on one state twice and so still counts twice
+    m_automaton.add(word, id);
+    m_automaton.add(std::string(word.rbegin(), word.rend()), id);
+    return id;
+}
+
+auto grid_search::add_stencil(const std::vector<std::string_view> &rows) -> size_t
+{
+    const auto id = static_cast<uint32_t>(m_cPatterns++);
+    stencil s { id, {}, 0, 0, 0, 0 };
+    char anchor = WILDCARD;
+    int anchorRow = 0, anchorCol = 0;
+    for (size_t ixRow = 0; ixRow < rows.size(); ixRow++)
+    {
+        for (size_t ixCol = 0; ixCol < rows[ixRow].size(); ixCol++)
+        {
+            const char c = rows[ixRow][ixCol];
+            if (WILDCARD == c) continue;
+            if (WILDCARD == anchor)
+            {
+                anchor = c;
+                anchorRow = static_cast<int>(ixRow);
+                anchorCol = static_cast<int>(ixCol);
+                continue;
+            }
+            s.cells.push_back({ static_cast<int>(ixRow) - anchorRow,
+                                static_cast<int>(ixCol) - anchorCol, c });
+        }
+    }
+    // a stencil of wildcards only has no anchor and never matches
+    if (WILDCARD == anchor) return id;
+
+    const auto width = std::max_element(rows.begin(), rows.end(),
+        [](auto lhs, auto rhs) { return lhs.size() < rhs.size(); })->size();
+    s.minRow = -anchorRow;
+    s.maxRow = static_cast<int>(rows.size()) - 1 - anchorRow;
+    s.minCol = -anchorCol;
+    s.maxCol = static_cast<int>(width) - 1 - anchorCol;
+    m_stencils_by_anchor[static_cast<uint8_t>(anchor)].emplace_back(std::move(s));
+    return id;
+}
+
+void grid_search::build()
+{
+    m_automaton.build();
+}
+
+auto grid_search::search(const grid &g, size_t firstRow, size_t lastRow) const
+    -> std::vector<int64_t>
+{
+    std::vector<int64_t> counts(m_cPatterns, 0);
+    if (firstRow >= lastRow || 0 == g.cols()) return counts;
+
+    const size_t cRows = g.rows(), cCols = g.cols();
+    const ptrdiff_t stride = g.stride();
+    std::vector<uint64_t> hits(m_automaton.state_count(), 0);
+    // one automaton state per line of each direction; walking row-major
+    // visits every column and diagonal in order
+    std::vector<uint32_t> down(cCols, 0);
+    std::vector<uint32_t> falling(cRows + cCols - 1, 0);
+    std::vector<uint32_t> rising(cRows + cCols - 1, 0);
+    // a word ending on firstRow can start this many rows above it
+    const size_t warmup = std::min(firstRow, m_longest_word > 0 ? m_longest_word - 1 : 0);
+    for (size_t ixRow = firstRow - warmup; ixRow < lastRow; ixRow++)
+    {
+        const char *row = g.cell(ixRow, 0);
+        const uint64_t counted = ixRow >= firstRow;
+        uint32_t across = 0;
+        for (size_t ixCol = 0; ixCol < cCols; ixCol++)
+        {
+            const char c = row[ixCol];
+            across = m_automaton.next(across, c);
+            hits[across] += counted;
+            uint32_t &col_state = down[ixCol];
+            col_state = m_automaton.next(col_state, c);
+            hits[col_state] += counted;
+            uint32_t &falling_state = falling[ixCol + cRows - 1 - ixRow];
+            falling_state = m_automaton.next(falling_state, c);
+            hits[falling_state] += counted;
+            uint32_t &rising_state = rising[ixRow + ixCol];
+            rising_state = m_automaton.next(rising_state, c);
+            hits[rising_state] += counted;
+
+            if (!counted) continue;
+            for (const stencil &s : m_stencils_by_anchor[static_cast<uint8_t>(c)])
+            {
+                const auto r = static_cast<ptrdiff_t>(ixRow);
+                const auto col = static_cast<ptrdiff_t>(ixCol);
+                if (r + s.minRow < 0 || r + s.maxRow >= static_cast<ptrdiff_t>(cRows) ||
+                    col + s.minCol < 0 || col + s.maxCol >= static_cast<ptrdiff_t>(cCols))
+                    continue;
+                const char *anchor = row + ixCol;
+                const bool match = std::all_of(s.cells.begin(), s.cells.end(),
+                    [&](const stencil_cell &cell)
+                    {
+                        return cell.c == anchor[cell.dRow * stride + cell.dCol];
+                    });
+                counts[s.id] += match;
+            }
+        }
+    }
+
+    // root visits are not matches of anything
+    hits[0] = 0;
+    m_automaton.collect(hits, counts);
+    return counts;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "grid.h"
+
+/// @brief Aho-Corasick automaton compiled to a full DFA over the symbols
+///        that occur in its words. Every other character maps to symbol 0,
+///        which leads back to the root.
+class aho_corasick
+{
+public:
+    void add(std::string_view word, uint32_t id);
+    void build();
+
+    auto state_count() const -> size_t { return m_fail.size(); }
+
+    auto next(uint32_t state, char c) const -> uint32_t
+    {
+        return m_next[state * m_cSymbols + m_symbol_of[static_cast<uint8_t>(c)]];
+    }
+
+    /// @brief Turns per-state visit counts into per-word match counts:
+    ///        a visit to a state is a match of every word ending there and
+    ///        of every word that is a suffix of it.
+    void collect(std::vector<uint64_t> &hits, std::vector<int64_t> &counts) const;
+
+private:
+    auto add_state() -> uint32_t;
+
+    std::vector<std::pair<std::string, uint32_t>> m_pending;
+    std::array<uint8_t, 256> m_symbol_of {};
+    size_t m_cSymbols = 1;
+    std::vector<uint32_t> m_next;
+    std::vector<uint32_t> m_fail;
+    std::vector<std::vector<uint32_t>> m_ids;
+    std::vector<uint32_t> m_bfs_order;
+};
+
+/// @brief Finds many words and 2D stencils in a grid in a single row-major
+///        pass. Words are counted along all eight directions: each word and
+///        its reverse go into one automaton, which is run along rows,
+///        columns and both diagonals at once by keeping one automaton state
+///        per column and per diagonal. Stencils are rows of equal length
+///        where '.' matches any cell; they are bucketed by their first
+///        fixed cell and tried only where that cell matches.
+class grid_search
+{
+public:
+    static constexpr char WILDCARD = '.';
+
+    auto add_word(std::string_view word) -> size_t;
+    auto add_stencil(const std::vector<std::string_view> &rows) -> size_t;
+    void build();
+
+    /// @brief Match count of every pattern, indexed by the id add_* gave it.
+    auto search(const grid &g) const -> std::vector<int64_t>
+    {
+        return search(g, 0, g.rows());
+    }
+
+    /// @brief Counts only the matches anchored on rows [firstRow, lastRow):
+    ///        words by the cell they end on, stencils by their anchor cell.
+    ///        The automata are warmed up on the rows just above, so the
+    ///        counts of adjacent ranges add up to the count of their union.
+    auto search(const grid &g, size_t firstRow, size_t lastRow) const -> std::vector<int64_t>;
+
+private:
+    struct stencil_cell
+    {
+        int dRow;
+        int dCol;
+        char c;
+    };
+
+    struct stencil
+    {
+        uint32_t id;
+        std::vector<stencil_cell> cells; // relative to the anchor cell
+        int minRow, maxRow, minCol, maxCol;
+    };
+
+    size_t m_cPatterns = 0;
+    size_t m_longest_word = 0;
+    aho_corasick m_automaton;
+    std::array<std::vector<stencil>, 256> m_stencils_by_anchor;
+};
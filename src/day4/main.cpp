@@ -0,0 +1,6 @@
+#include "day4.h"
+
+int main(int argc, char *argv[])
+{
+    return day4::run(argc, argv);
+}
@@ -1,164 +1,498 @@
+#include "day5.h"
 #include "assert.h"
 #include <algorithm>
-#include <charconv>
-#include <fstream>
+#include <cstdint>
 #include <iostream>
-#include <sstream>
+#include <iterator>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
-using rule_pair = std::pair<int, int>;
-using rule_map = std::unordered_map<int, std::vector<int>>;
-using update = std::vector<int>;
+#include "input_cache.h"
+#include "rule_index.h"
+#include "text_scan.h"
+#include "thread_pool.h"
+#include "topological_sorter.h"
+
+namespace day5
+{
 
 constexpr char RULE_DELIMITER = '|';
 constexpr char UPDATE_DELIMITER = ',';
 
-auto parse_rule(const std::string &rule) -> rule_pair
+/// @brief Updates of one chunk of input, every page in one flat buffer.
+struct update_arena
+{
+    std::vector<int> pages;
+    std::vector<size_t> offsets { 0 };
+
+    auto size() const -> size_t { return offsets.size() - 1; }
+    auto operator[](size_t ix) -> std::span<int>
+    {
+        return { pages.data() + offsets[ix], offsets[ix + 1] - offsets[ix] };
+    }
+};
+
+/// @brief Both answers over some run of updates: the middle pages of the
+///        updates already in order and of the ones that had to be fixed.
+struct update_sums
+{
+    int64_t valid = 0;
+    int64_t reordered = 0;
+    size_t cUpdates = 0;
+    // updates whose rules form a cycle, counted from the first update
+    std::vector<size_t> cycles;
+
+    auto operator+=(const update_sums &rhs) -> update_sums &
+    {
+        for (const size_t ixUpdate : rhs.cycles) cycles.emplace_back(cUpdates + ixUpdate);
+        valid += rhs.valid;
+        reordered += rhs.reordered;
+        cUpdates += rhs.cUpdates;
+        return *this;
+    }
+};
+
+auto parse_rule(std::string_view rule) -> rule_pair
 {
     rule_pair parsed_rule {};
     const size_t ixDelim = rule.find(RULE_DELIMITER);
-    if (std::string::npos == ixDelim) return parsed_rule;
+    if (std::string_view::npos == ixDelim) return parsed_rule;
 
     auto &[lhs, rhs] = parsed_rule;
-    std::from_chars(rule.data(), rule.data() + ixDelim, lhs);
-    std::from_chars(rule.data() + ixDelim + 1, rule.data() + rule.size(), rhs);
+    lhs = to_int(rule.substr(0, ixDelim));
+    rhs = to_int(rule.substr(ixDelim + 1));
     return parsed_rule;
 }
 
-auto parse_update(std::istringstream &&update_stream) -> update
+/// @brief Splits the input into its rules and its updates. The updates
+///        start at the first non-empty line that is not a rule, so the blank
+///        line between the sections is optional and may end in CRLF.
+auto split_sections(std::string_view text) -> std::pair<std::string_view, std::string_view>
 {
-    update update_pages;
-
-    for (std::string tok; std::getline(update_stream, tok, UPDATE_DELIMITER);)
+    for (const std::string_view line : lines(text))
     {
-        auto &v = update_pages.emplace_back();
-        std::from_chars(tok.data(), tok.data() + tok.size(), v);
+        if (line.empty() || std::string_view::npos != line.find(RULE_DELIMITER)) continue;
+        const size_t ixUpdates = static_cast<size_t>(line.data() - text.data());
+        return { text.substr(0, ixUpdates), text.substr(ixUpdates) };
     }
-    return update_pages;
+    return { text, {} };
 }
 
-auto parse_file(const char *filename) ->
-    std::pair<std::vector<rule_pair>, std::vector<update>>
+auto parse_rules(std::string_view text) -> std::vector<rule_pair>
 {
     std::vector<rule_pair> rules {};
-    std::vector<update> update_list {};
-    std::ifstream input_file { filename };
-    if (input_file.fail()) return {};
-
-    for (std::string line; std::getline(input_file, line); )
+    rules.reserve(estimate_line_count(text));
+    for (const std::string_view line : lines(text))
     {
-        if (std::string::npos != line.find(RULE_DELIMITER))
+        if (std::string_view::npos != line.find(RULE_DELIMITER))
             rules.emplace_back(parse_rule(line));
-        else if (line.size() > 0)
-            update_list.emplace_back(parse_update(std::istringstream(line)));
     }
-    return std::make_pair(rules, update_list);
+    return rules;
 }
 
-auto update_is_valid(const update &update_order, const rule_map &rules) -> bool
+auto parse_updates(std::string_view text) -> update_arena
 {
-    std::vector<int> tmp;
-    tmp.reserve(update_order.size());
+    update_arena ret {};
+    // every page takes at least a digit and a delimiter
+    ret.pages.reserve(text.size() / 2);
+    ret.offsets.reserve(estimate_line_count(text) + 1);
+    for (std::string_view line : lines(text))
+    {
+        // a rule among the updates is not an update
+        if (std::string_view::npos != line.find(RULE_DELIMITER)) continue;
+        int page {};
+        while (scan_int(line, page, UPDATE_DELIMITER)) ret.pages.emplace_back(page);
+        if (ret.pages.size() != ret.offsets.back())
+            ret.offsets.emplace_back(ret.pages.size());
+    }
+    return ret;
+}
+
+/// @brief update_is_valid for dense rules: each page's successor row is
+///        tested against the set of pages up to and including it.
+auto update_is_valid_rows(std::span<const int> update_order, const rule_index &rules,
+                          std::span<uint64_t> seen) -> bool
+{
+    std::fill(seen.begin(), seen.end(), 0);
+    for (const int page : update_order)
+    {
+        const int ixRule = rules.index_of(page);
+        if (rule_index::NO_PAGE == ixRule) continue;
+
+        const auto bit = static_cast<size_t>(ixRule);
+        seen[bit / 64] |= uint64_t { 1 } << (bit % 64);
+        const auto successors = rules.successor_row(ixRule);
+        for (size_t ixWord = 0; ixWord < successors.size(); ixWord++)
+            if (0 != (successors[ixWord] & seen[ixWord])) return false;
+    }
+    return true;
+}
+
+/// @brief An update is invalid if some page must precede a page at or
+///        before its own position. Positions are recorded once, so each
+///        rule out of a page of the update is a single lookup.
+auto update_is_valid(std::span<const int> update_order, const rule_index &rules,
+                     page_positions &positions) -> bool
+{
+    if (rules.prefers_rows()) return update_is_valid_rows(update_order, rules, positions.seen());
 
-    for (const auto &update_val : update_order)
+    positions.assign(update_order);
+    bool valid = true;
+    for (size_t ixPage = 0; ixPage < update_order.size() && valid; ixPage++)
     {
-        tmp.emplace_back(update_val);
-        const auto it = rules.find(update_val);
-        if (rules.end() == it) continue;
+        const int ixRule = positions.index(ixPage);
+        if (rule_index::NO_PAGE == ixRule) continue;
 
-        for (const auto &bad_value : tmp)
+        for (const int ixSuccessor : rules.successors(ixRule))
         {
-            const auto &deps = it->second;
-            const auto itBad = std::find(deps.begin(), deps.end(), bad_value);
-            if (deps.end() != itBad) return false;
+            const int position = positions.position(ixSuccessor);
+            if (page_positions::ABSENT != position && position <= static_cast<int>(ixPage))
+            {
+                valid = false;
+                break;
+            }
         }
     }
+    positions.clear();
+    return valid;
+}
 
-    return true;
+enum class update_status
+{
+    valid,
+    reordered,
+    cycle
+};
+
+struct update_result
+{
+    update_status status = update_status::valid;
+    int middle = 0; // middle page once in order, unset for a cycle
+
+    auto operator==(const update_result &) const -> bool = default;
+};
+
+/// @brief Validates one update and finds its middle page, reordering
+///        @p update_order if it is out of order.
+auto evaluate_update(std::span<int> update_order, const rule_index &rules,
+                     page_positions &positions, topological_sorter &sorter) -> update_result
+{
+    if (update_is_valid(update_order, rules, positions))
+        return { update_status::valid, update_order[(update_order.size() - 1) / 2] };
+
+    // only the middle page counts, so the update is never fully sorted
+    const auto middle = sorter.middle(update_order);
+    if (!middle) return { update_status::cycle, 0 };
+    return { update_status::reordered, *middle };
 }
 
-auto puzzle1(const char *filename) -> int
+/// @brief Validates, and where needed reorders, one run of updates.
+auto evaluate_updates(update_arena &updates, const rule_index &rules,
+                      topological_sorter &sorter) -> update_sums
 {
-    auto [rules, updates] = parse_file(filename);
-    rule_map rule_dependencies {};
-    rule_dependencies.reserve(rules.size());
-    for (const auto &[rule, dependency] : rules)
+    update_sums ret {};
+    page_positions positions { rules };
+    ret.cUpdates = updates.size();
+    for (size_t ixUpdate = 0; ixUpdate < updates.size(); ixUpdate++)
     {
-        auto &dependencies = rule_dependencies[rule];
-        dependencies.emplace_back(dependency);
+        const auto [status, middle] = evaluate_update(updates[ixUpdate], rules, positions, sorter);
+        if (update_status::valid == status) ret.valid += middle;
+        else if (update_status::reordered == status) ret.reordered += middle;
+        else ret.cycles.emplace_back(ixUpdate);
     }
+    return ret;
+}
 
-    int sum = 0;
-    for (const auto &update_order : updates)
-    {
-        const bool valid = update_is_valid(update_order, rule_dependencies);
-        if (valid)
+/// @brief Both answers in one pass. The rule index is built once and
+///        shared read-only; the update section is cut into line-aligned
+///        chunks that are parsed and evaluated on the pool, each into its
+///        own arena.
+auto evaluate_text(std::string_view text, thread_pool &pool) -> update_sums
+{
+    const auto [rule_text, update_text] = split_sections(text);
+    const rule_index rules { parse_rules(rule_text) };
+    const topological_sorter shared_sorter { rules };
+
+    // a few chunks per thread so a slow chunk does not hold up the rest
+    constexpr size_t CHUNKS_PER_THREAD = 4;
+    const auto chunks = split_chunks(update_text,
+                                     1 == pool.size() ? 1 : pool.size() * CHUNKS_PER_THREAD);
+    auto sums = parallel_reduce(pool, chunks.size(), update_sums {}, [&](size_t ix)
         {
-            const size_t ixMid = (update_order.size() - 1) / 2;
-            sum += update_order[ixMid];
-        }
-    }
+            update_arena updates = parse_updates(chunks[ix]);
+            topological_sorter sorter = shared_sorter;
+            return evaluate_updates(updates, rules, sorter);
+        });
+
+    for (const size_t ixUpdate : sums.cycles)
+        std::cerr << "Rules form a cycle in update " << ixUpdate + 1 << '\n';
+    return sums;
+}
 
-    return sum;
+auto evaluate_file(const char *filename, thread_pool &pool) -> update_sums
+{
+    const auto input = input_cache::open(filename);
+    if (!input->is_open()) return {};
+    return evaluate_text(input->view(), pool);
 }
 
-auto update_less_than(int lhs, int rhs, const rule_map &rules) -> bool
+/// @brief Checks that the input gives the same sums when its line breaks
+///        are CRLF and when the blank line between the sections is left
+///        out.
+auto verify_layouts(const char *filename, thread_pool &pool) -> int
 {
-    const auto it = rules.find(lhs);
-    if (rules.end() == it) return false;
+    const auto input = input_cache::open(filename);
+    const auto expected = evaluate_text(input->view(), pool);
 
-    const auto &deps = it->second;
-    const auto itLess = std::find(deps.begin(), deps.end(), rhs);
-    return deps.end() != itLess;
+    std::string crlf {};
+    std::string no_blank {};
+    for (const std::string_view line : lines(input->view()))
+    {
+        crlf.append(line).append("\r\n");
+        if (!line.empty()) no_blank.append(line).push_back('\n');
+    }
+
+    int ret = 0;
+    for (const auto &[name, text] : { std::pair { "crlf", std::string_view { crlf } },
+                                      std::pair { "no blank line", std::string_view { no_blank } } })
+    {
+        const auto sums = evaluate_text(text, pool);
+        const bool same = expected.valid == sums.valid && expected.reordered == sums.reordered;
+        std::cout << name << ": " << sums.valid << ' ' << sums.reordered
+                  << (same ? "" : " mismatch") << '\n';
+        if (!same) ret = 1;
+    }
+    return ret;
 }
 
-auto puzzle2(const char *filename) -> int
+/// @brief Long-running form of the puzzle: rules and updates arrive as
+///        lines on a stream, in any order, and every update's result is
+///        written as soon as it is known. The rule index grows in place.
+///        A new rule X|Y can only change updates holding both X and Y, so
+///        just those are queued to be checked again; recheck() runs the
+///        queue once for a whole burst of rules and writes every update
+///        whose result changed.
+class update_service
 {
-    auto [rules, updates] = parse_file(filename);
-    rule_map rule_dependencies {};
-    rule_dependencies.reserve(rules.size());
-    for (const auto &[rule, dependency] : rules)
+public:
+    explicit update_service(std::ostream &out) :
+        m_out(out),
+        m_sorter(m_rules),
+        m_positions(m_rules)
     {
-        auto &dependencies = rule_dependencies[rule];
-        dependencies.emplace_back(dependency);
     }
 
-    int sum = 0;
-    for (auto &update_order : updates)
+    update_service(const update_service &) = delete;
+    update_service &operator=(const update_service &) = delete;
+
+    void add_rule(int lhs, int rhs)
     {
-        const bool valid = update_is_valid(update_order, rule_dependencies);
-        if (valid) { continue; }
+        const size_t cPages = m_rules.page_count();
+        const size_t cWords = m_rules.row_words();
+        if (!m_rules.add_rule(lhs, rhs)) return;
+        m_sorter.add_rule(m_rules.index_of(lhs), m_rules.index_of(rhs));
+        if (cPages != m_rules.page_count() || cWords != m_rules.row_words())
+            m_positions = page_positions { m_rules };
 
-        std::sort(update_order.begin(), update_order.end(),
-            [&](const auto &lhs, const auto &rhs)
-            {
-                return update_less_than(lhs, rhs, rule_dependencies);
-            });
+        const auto itLhs = m_updates_of_page.find(lhs);
+        const auto itRhs = m_updates_of_page.find(rhs);
+        if (m_updates_of_page.end() == itLhs || m_updates_of_page.end() == itRhs) return;
 
-        assert(update_is_valid(update_order, rule_dependencies));
-        const size_t ixMid = (update_order.size() - 1) / 2;
-        sum += update_order[ixMid];
+        // both lists are in update order, so they intersect in one merge
+        m_affected.clear();
+        std::set_intersection(itLhs->second.begin(), itLhs->second.end(),
+                              itRhs->second.begin(), itRhs->second.end(),
+                              std::back_inserter(m_affected));
+        for (const uint32_t ixUpdate : m_affected)
+        {
+            // more rules never untangle a cycle
+            if (m_queued[ixUpdate] || update_status::cycle == m_results[ixUpdate].status) continue;
+            m_queued[ixUpdate] = 1;
+            m_queue.emplace_back(ixUpdate);
+        }
     }
 
-    return sum;
+    void recheck()
+    {
+        for (const uint32_t ixUpdate : m_queue)
+        {
+            m_queued[ixUpdate] = 0;
+            const update_result result = evaluate(ixUpdate);
+            if (result == m_results[ixUpdate]) continue;
+            m_results[ixUpdate] = result;
+            write(ixUpdate);
+        }
+        m_queue.clear();
+    }
+
+    void add_update(std::string_view line)
+    {
+        const auto ixUpdate = static_cast<uint32_t>(m_updates.size());
+        int page {};
+        while (scan_int(line, page, UPDATE_DELIMITER))
+        {
+            m_updates.pages.emplace_back(page);
+            auto &updates = m_updates_of_page[page];
+            if (updates.empty() || ixUpdate != updates.back()) updates.emplace_back(ixUpdate);
+        }
+        if (m_updates.pages.size() == m_updates.offsets.back()) return;
+        m_updates.offsets.emplace_back(m_updates.pages.size());
+
+        m_results.emplace_back(evaluate(ixUpdate));
+        m_queued.emplace_back(0);
+        write(ixUpdate);
+    }
+
+    /// @brief Current sums over every update so far.
+    auto sums() const -> update_sums
+    {
+        update_sums ret {};
+        ret.cUpdates = m_results.size();
+        for (size_t ixUpdate = 0; ixUpdate < m_results.size(); ixUpdate++)
+        {
+            const auto [status, middle] = m_results[ixUpdate];
+            if (update_status::valid == status) ret.valid += middle;
+            else if (update_status::reordered == status) ret.reordered += middle;
+            else ret.cycles.emplace_back(ixUpdate);
+        }
+        return ret;
+    }
+
+private:
+    auto evaluate(size_t ixUpdate) -> update_result
+    {
+        // the stored update keeps its original order for later checks
+        const std::span<int> pages = m_updates[ixUpdate];
+        m_scratch.assign(pages.begin(), pages.end());
+        return evaluate_update(m_scratch, m_rules, m_positions, m_sorter);
+    }
+
+    void write(size_t ixUpdate)
+    {
+        constexpr std::string_view STATUS_NAMES[] = { "valid", "reordered", "cycle" };
+        const auto [status, middle] = m_results[ixUpdate];
+        m_out << ixUpdate + 1 << ' ' << STATUS_NAMES[static_cast<size_t>(status)];
+        if (update_status::cycle != status) m_out << ' ' << middle;
+        m_out << '\n';
+    }
+
+    std::ostream &m_out;
+    rule_index m_rules;
+    topological_sorter m_sorter;
+    page_positions m_positions;
+    update_arena m_updates;
+    std::vector<update_result> m_results;
+    std::unordered_map<int, std::vector<uint32_t>> m_updates_of_page;
+    std::vector<uint32_t> m_affected;
+    std::vector<uint32_t> m_queue;
+    std::vector<uint8_t> m_queued;
+    std::vector<int> m_scratch;
+};
+
+/// @brief Runs an update_service over stdin until it closes, then writes
+///        both sums. Queued rechecks run and output is flushed whenever the
+///        input runs dry, so a result is never held back waiting for more
+///        input.
+auto serve() -> int
+{
+    // unsynced, cin buffers its input and in_avail() tells when it is empty
+    std::ios::sync_with_stdio(false);
+    update_service service { std::cout };
+    std::string line;
+    while (std::getline(std::cin, line))
+    {
+        const std::string_view text = line;
+        if (std::string_view::npos != text.find(RULE_DELIMITER))
+        {
+            const auto [lhs, rhs] = parse_rule(text);
+            service.add_rule(lhs, rhs);
+        }
+        else if (!text.empty())
+        {
+            // results of earlier updates come out before later ones
+            service.recheck();
+            service.add_update(text);
+        }
+        if (0 >= std::cin.rdbuf()->in_avail())
+        {
+            service.recheck();
+            std::cout.flush();
+        }
+    }
+    service.recheck();
+
+    const auto sums = service.sums();
+    std::cout << sums.valid << '\n' << sums.reordered << '\n';
+    return 0;
+}
+
+auto puzzle1(const char *filename, thread_pool &pool) -> int64_t
+{
+    return evaluate_file(filename, pool).valid;
+}
+
+auto puzzle2(const char *filename, thread_pool &pool) -> int64_t
+{
+    return evaluate_file(filename, pool).reordered;
+}
+
+auto part1(const char *filename, thread_pool &pool) -> int64_t
+{
+    return puzzle1(filename, pool);
+}
+
+auto part2(const char *filename, thread_pool &pool) -> int64_t
+{
+    return puzzle2(filename, pool);
+}
+
+auto both_parts(const char *filename, thread_pool &pool) -> std::pair<int64_t, int64_t>
+{
+    const auto sums = evaluate_file(filename, pool);
+    return { sums.valid, sums.reordered };
 }
 
-int main(int argc, char *argv[])
+auto run(int argc, char *argv[]) -> int
 {
+    // -j N: worker threads, 0 for one per core
+    size_t cThreads = 1;
+    if (argc > 3 && std::string_view("-j") == argv[1])
+    {
+        cThreads = to_int<size_t>(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
+    thread_pool pool { cThreads };
+
     if (3 != argc)
     {
         std::cout << "Incorrect number of argumnets";
         return 1;
     }
+    else if (std::string_view("serve") == argv[1] && std::string_view("-") == argv[2])
+    {
+        return serve();
+    }
+    else if (std::string_view("verify") == argv[1])
+    {
+        return verify_layouts(argv[2], pool);
+    }
+    else if (std::string_view("both") == argv[1])
+    {
+        const auto sums = evaluate_file(argv[2], pool);
+        std::cout << sums.valid << '\n' << sums.reordered << '\n';
+    }
     else if ('1' == argv[1][0])
     {
-        std::cout << puzzle1(argv[2]) << '\n';
+        std::cout << puzzle1(argv[2], pool) << '\n';
     }
     else if ('2' == argv[1][0])
     {
-        std::cout << puzzle2(argv[2]) << '\n';
+        std::cout << puzzle2(argv[2], pool) << '\n';
     }
     else
     {
@@ -168,3 +502,5 @@ int main(int argc, char *argv[])
 
     return 0;
 }
+
+} // namespace day5
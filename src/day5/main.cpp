@@ -0,0 +1,6 @@
+#include "day5.h"
+
+int main(int argc, char *argv[])
+{
+    return day5::run(argc, argv);
+}
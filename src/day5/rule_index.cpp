@@ -0,0 +1,139 @@
+#include "rule_index.h"
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+// widest page range given a flat lookup table
+constexpr int64_t MAX_PAGE_TABLE_SPAN = 1 << 16;
+
+rule_index::rule_index(const std::vector<rule_pair> &rules)
+{
+    int min_page = std::numeric_limits<int>::max();
+    int max_page = std::numeric_limits<int>::min();
+    for (const auto &[lhs, rhs] : rules)
+    {
+        min_page = std::min({ min_page, lhs, rhs });
+        max_page = std::max({ max_page, lhs, rhs });
+    }
+    if (rules.empty()) return;
+
+    if (int64_t { max_page } - min_page < MAX_PAGE_TABLE_SPAN)
+    {
+        m_min_page = min_page;
+        m_page_table.assign(static_cast<size_t>(int64_t { max_page } - min_page + 1), NO_PAGE);
+    }
+    std::vector<std::pair<int, int>> edges {};
+    edges.reserve(rules.size());
+    for (const auto &[lhs, rhs] : rules)
+    {
+        const int ixLhs = add_page(lhs);
+        edges.emplace_back(ixLhs, add_page(rhs));
+    }
+
+    m_row_words = (m_cPages + 63) / 64;
+    m_cRows = m_cPages;
+    m_matrix.assign(m_cPages * m_row_words, 0);
+    m_transposed.assign(m_cPages * m_row_words, 0);
+    for (const auto &[ixLhs, ixRhs] : edges)
+    {
+        const auto lhs = static_cast<size_t>(ixLhs), rhs = static_cast<size_t>(ixRhs);
+        m_matrix[lhs * m_row_words + rhs / 64] |= uint64_t { 1 } << (rhs % 64);
+        m_transposed[rhs * m_row_words + lhs / 64] |= uint64_t { 1 } << (lhs % 64);
+    }
+
+    // successor lists straight from the matrix, which also drops repeats
+    m_successors.assign(m_cPages, {});
+    for (size_t ixLhs = 0; ixLhs < m_cPages; ixLhs++)
+    {
+        for (size_t ixWord = 0; ixWord < m_row_words; ixWord++)
+        {
+            for (uint64_t bits = m_matrix[ixLhs * m_row_words + ixWord]; 0 != bits; bits &= bits - 1)
+                m_successors[ixLhs].emplace_back(static_cast<int>(ixWord * 64 + std::countr_zero(bits)));
+        }
+        m_cRules += m_successors[ixLhs].size();
+    }
+}
+
+auto rule_index::add_rule(int lhs, int rhs) -> bool
+{
+    const auto ixLhs = static_cast<size_t>(add_page(lhs));
+    const auto ixRhs = static_cast<size_t>(add_page(rhs));
+    if (m_cPages > m_row_words * 64) widen_rows(std::max<size_t>(1, 2 * m_row_words));
+    if (m_cPages > m_cRows) grow_rows(std::max<size_t>(m_cPages, 2 * m_cRows));
+    if (m_cPages > m_successors.size()) m_successors.resize(m_cPages);
+
+    const uint64_t bit = uint64_t { 1 } << (ixRhs % 64);
+    uint64_t &word = m_matrix[ixLhs * m_row_words + ixRhs / 64];
+    if (0 != (word & bit)) return false;
+    word |= bit;
+    m_transposed[ixRhs * m_row_words + ixLhs / 64] |= uint64_t { 1 } << (ixLhs % 64);
+    auto &successors = m_successors[ixLhs];
+    successors.insert(std::lower_bound(successors.begin(), successors.end(), static_cast<int>(ixRhs)),
+                      static_cast<int>(ixRhs));
+    m_cRules++;
+    return true;
+}
+
+void rule_index::widen_rows(size_t cWords)
+{
+    for (auto *matrix : { &m_matrix, &m_transposed })
+    {
+        std::vector<uint64_t> wide(m_cRows * cWords, 0);
+        for (size_t ixRow = 0; ixRow < m_cRows; ixRow++)
+        {
+            std::copy_n(matrix->begin() + static_cast<ptrdiff_t>(ixRow * m_row_words), m_row_words,
+                        wide.begin() + static_cast<ptrdiff_t>(ixRow * cWords));
+        }
+        *matrix = std::move(wide);
+    }
+    m_row_words = cWords;
+}
+
+void rule_index::grow_rows(size_t cRows)
+{
+    m_matrix.resize(cRows * m_row_words, 0);
+    m_transposed.resize(cRows * m_row_words, 0);
+    m_cRows = cRows;
+}
+
+auto rule_index::add_page(int page) -> int
+{
+    const bool covered = !m_page_table.empty() && page >= m_min_page &&
+                         int64_t { page } - m_min_page < static_cast<int64_t>(m_page_table.size());
+    if (m_page_map.empty() && !covered)
+    {
+        // widen the flat table to take the page, or give it up for the map
+        // once the range grows too wide. The table at least doubles, towards
+        // the new page, so pages arriving in order copy it only log times.
+        const int64_t min_page = m_page_table.empty() ? page : std::min(m_min_page, page);
+        const int64_t max_page = m_page_table.empty() ? page :
+            std::max<int64_t>(m_min_page + static_cast<int64_t>(m_page_table.size()) - 1, page);
+        if (max_page - min_page < MAX_PAGE_TABLE_SPAN)
+        {
+            const int64_t span = std::min(MAX_PAGE_TABLE_SPAN,
+                std::max(max_page - min_page + 1, 2 * static_cast<int64_t>(m_page_table.size())));
+            const int64_t new_min_page = page < m_min_page && !m_page_table.empty() ?
+                std::max<int64_t>(max_page - span + 1, std::numeric_limits<int>::min()) : min_page;
+            std::vector<int> table(static_cast<size_t>(span), NO_PAGE);
+            std::copy(m_page_table.begin(), m_page_table.end(),
+                      table.begin() + (m_page_table.empty() ? 0 : m_min_page - new_min_page));
+            m_page_table = std::move(table);
+            m_min_page = static_cast<int>(new_min_page);
+        }
+        else
+        {
+            for (size_t offset = 0; offset < m_page_table.size(); offset++)
+            {
+                if (NO_PAGE != m_page_table[offset])
+                    m_page_map.emplace(m_min_page + static_cast<int>(offset), m_page_table[offset]);
+            }
+            m_page_table.clear();
+        }
+    }
+
+    int &ix = m_page_table.empty() ?
+        m_page_map.try_emplace(page, NO_PAGE).first->second :
+        m_page_table[static_cast<size_t>(int64_t { page } - m_min_page)];
+    if (NO_PAGE == ix) ix = static_cast<int>(m_cPages++);
+    return ix;
+}
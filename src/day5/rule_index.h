@@ -0,0 +1,157 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using rule_pair = std::pair<int, int>;
+
+/// @brief The ordering rules as a dense bit matrix: bit (a, b) is set when
+///        page a must precede page b. Pages are remapped to indices
+///        0..page_count() in order of first appearance, so the matrix is
+///        only as large as the number of distinct pages in the rules. The
+///        same edges are also kept transposed, one predecessor row per
+///        page, and as a sorted successor list per page.
+class rule_index
+{
+public:
+    static constexpr int NO_PAGE = -1;
+
+    rule_index() = default;
+    explicit rule_index(const std::vector<rule_pair> &rules);
+
+    /// @brief Adds one rule in place. New pages take the next indices, so
+    ///        existing indices stay valid; the bit rows double in width or
+    ///        height whenever the pages outgrow them, and only lhs's own
+    ///        successor list takes the new entry.
+    /// @return false if the rule was already there
+    auto add_rule(int lhs, int rhs) -> bool;
+
+    auto page_count() const -> size_t { return m_cPages; }
+
+    /// @brief Dense index of @p page, NO_PAGE if no rule mentions it.
+    auto index_of(int page) const -> int
+    {
+        if (!m_page_table.empty())
+        {
+            const int64_t offset = int64_t { page } - m_min_page;
+            if (offset < 0 || offset >= static_cast<int64_t>(m_page_table.size())) return NO_PAGE;
+            return m_page_table[static_cast<size_t>(offset)];
+        }
+        const auto it = m_page_map.find(page);
+        return m_page_map.end() == it ? NO_PAGE : it->second;
+    }
+
+    /// @brief Whether the page at index @p ixLhs must precede @p ixRhs.
+    auto precedes_index(int ixLhs, int ixRhs) const -> bool
+    {
+        const size_t bit = static_cast<size_t>(ixRhs);
+        return (m_matrix[static_cast<size_t>(ixLhs) * m_row_words + bit / 64] >> (bit % 64)) & 1;
+    }
+
+    auto precedes(int lhs, int rhs) const -> bool
+    {
+        const int ixLhs = index_of(lhs);
+        const int ixRhs = index_of(rhs);
+        return NO_PAGE != ixLhs && NO_PAGE != ixRhs && precedes_index(ixLhs, ixRhs);
+    }
+
+    auto row_words() const -> size_t { return m_row_words; }
+
+    /// @brief Bit set of the pages that page @p ixPage must precede.
+    auto successor_row(int ixPage) const -> std::span<const uint64_t>
+    {
+        return { m_matrix.data() + static_cast<size_t>(ixPage) * m_row_words, m_row_words };
+    }
+
+    /// @brief Bit set of the pages that must precede page @p ixPage.
+    auto predecessor_row(int ixPage) const -> std::span<const uint64_t>
+    {
+        return { m_transposed.data() + static_cast<size_t>(ixPage) * m_row_words, m_row_words };
+    }
+
+    /// @brief Whether a page's bit row is no more words than it has
+    ///        successors on average, so whole-row tests beat walking
+    ///        successor lists.
+    auto prefers_rows() const -> bool { return m_row_words * m_cPages <= m_cRules; }
+
+    /// @brief Indices of every page that page @p ixPage must precede, in
+    ///        ascending order.
+    auto successors(int ixPage) const -> std::span<const int>
+    {
+        return m_successors[static_cast<size_t>(ixPage)];
+    }
+
+private:
+    auto add_page(int page) -> int;
+    void widen_rows(size_t cWords);
+    void grow_rows(size_t cRows);
+
+    size_t m_cPages = 0;
+    size_t m_row_words = 0;
+    // both matrices hold m_cRows rows, at least one per page
+    size_t m_cRows = 0;
+    std::vector<uint64_t> m_matrix;
+    std::vector<uint64_t> m_transposed;
+    // one list per page, so a new rule only shifts its own page's list
+    std::vector<std::vector<int>> m_successors;
+    size_t m_cRules = 0;
+    // page numbers are usually small, so the lookup is a flat table over
+    // their range; a hash map backs it when the range is too wide
+    int m_min_page = 0;
+    std::vector<int> m_page_table;
+    std::unordered_map<int, int> m_page_map;
+};
+
+/// @brief Where each rule page first appears in one update, indexed by
+///        its rule_index page index. Sized once for the whole rule set and
+///        reset after each update in time proportional to the update.
+class page_positions
+{
+public:
+    static constexpr int ABSENT = -1;
+
+    explicit page_positions(const rule_index &rules) :
+        m_rules(&rules),
+        m_positions(rules.page_count(), ABSENT),
+        m_seen(rules.row_words(), 0)
+    {
+    }
+
+    /// @brief Scratch set of pages, one bit per page index, for checks
+    ///        that go a bit row at a time.
+    auto seen() -> std::span<uint64_t> { return m_seen; }
+
+    void assign(std::span<const int> pages)
+    {
+        m_indices.resize(pages.size());
+        for (size_t ixPage = 0; ixPage < pages.size(); ixPage++)
+        {
+            const int ix = m_rules->index_of(pages[ixPage]);
+            m_indices[ixPage] = ix;
+            if (rule_index::NO_PAGE != ix && ABSENT == m_positions[static_cast<size_t>(ix)])
+                m_positions[static_cast<size_t>(ix)] = static_cast<int>(ixPage);
+        }
+    }
+
+    void clear()
+    {
+        for (const int ix : m_indices)
+            if (rule_index::NO_PAGE != ix) m_positions[static_cast<size_t>(ix)] = ABSENT;
+        m_indices.clear();
+    }
+
+    /// @brief rule_index page index of the page at @p ixPage of the update.
+    auto index(size_t ixPage) const -> int { return m_indices[ixPage]; }
+
+    /// @brief First position of page index @p ixRule, ABSENT if missing.
+    auto position(int ixRule) const -> int { return m_positions[static_cast<size_t>(ixRule)]; }
+
+private:
+    const rule_index *m_rules;
+    std::vector<int> m_positions;
+    std::vector<int> m_indices;
+    std::vector<uint64_t> m_seen;
+};
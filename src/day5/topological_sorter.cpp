@@ -0,0 +1,309 @@
+#include "topological_sorter.h"
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+constexpr int NO_SLOT = -1;
+
+topological_sorter::topological_sorter(const rule_index &rules) :
+    m_rules(&rules),
+    m_first_slot(rules.page_count(), NO_SLOT)
+{
+    rank_pages();
+}
+
+void topological_sorter::add_rule(int ixLhs, int ixRhs)
+{
+    m_first_slot.resize(m_rules->page_count(), NO_SLOT);
+    // more rules never break a cycle
+    if (!m_has_order) return;
+    if (ixLhs == ixRhs)
+    {
+        m_has_order = false;
+        m_rank.clear();
+        return;
+    }
+
+    // a new page has no other rules yet, so it can go at either end
+    const size_t cRanked = m_rank.size();
+    m_rank.resize(m_rules->page_count(), 0);
+    if (static_cast<size_t>(ixLhs) >= cRanked) m_rank[static_cast<size_t>(ixLhs)] = --m_min_rank;
+    if (static_cast<size_t>(ixRhs) >= cRanked) m_rank[static_cast<size_t>(ixRhs)] = ++m_max_rank;
+    if (m_rank[static_cast<size_t>(ixLhs)] > m_rank[static_cast<size_t>(ixRhs)]) rerank(ixLhs, ixRhs);
+}
+
+/// @brief Repairs the ranks after a rule lhs|rhs that runs against them
+///        (Pearce-Kelly): only pages ranked between rhs and lhs can be out
+///        of place. Those reachable from rhs and those reaching lhs swap
+///        their ranks around so the latter come first; reaching lhs from
+///        rhs means the rule closed a cycle.
+void topological_sorter::rerank(int ixLhs, int ixRhs)
+{
+    const int lower = m_rank[static_cast<size_t>(ixRhs)];
+    const int upper = m_rank[static_cast<size_t>(ixLhs)];
+    std::vector<uint8_t> visited(m_rank.size(), 0);
+    std::vector<int> forward { ixRhs }, backward { ixLhs };
+    visited[static_cast<size_t>(ixRhs)] = 1;
+    visited[static_cast<size_t>(ixLhs)] = 1;
+
+    for (size_t ixStack = 0; ixStack < forward.size(); ixStack++)
+    {
+        for (const int ixNext : m_rules->successors(forward[ixStack]))
+        {
+            if (ixNext == ixLhs)
+            {
+                m_has_order = false;
+                m_rank.clear();
+                return;
+            }
+            const auto next = static_cast<size_t>(ixNext);
+            if (visited[next] || m_rank[next] > upper) continue;
+            visited[next] = 1;
+            forward.emplace_back(ixNext);
+        }
+    }
+    for (size_t ixStack = 0; ixStack < backward.size(); ixStack++)
+    {
+        const auto predecessors = m_rules->predecessor_row(backward[ixStack]);
+        for (size_t ixWord = 0; ixWord < predecessors.size(); ixWord++)
+        {
+            for (uint64_t bits = predecessors[ixWord]; 0 != bits; bits &= bits - 1)
+            {
+                const size_t prev = ixWord * 64 + static_cast<size_t>(std::countr_zero(bits));
+                if (visited[prev] || m_rank[prev] < lower) continue;
+                visited[prev] = 1;
+                backward.emplace_back(static_cast<int>(prev));
+            }
+        }
+    }
+
+    // the same ranks, handed out again: everything reaching lhs, then
+    // everything reachable from rhs, each keeping its own order
+    const auto by_rank = [&](int lhs, int rhs)
+        { return m_rank[static_cast<size_t>(lhs)] < m_rank[static_cast<size_t>(rhs)]; };
+    std::sort(backward.begin(), backward.end(), by_rank);
+    std::sort(forward.begin(), forward.end(), by_rank);
+    std::vector<int> ranks {};
+    ranks.reserve(backward.size() + forward.size());
+    for (const auto *pages : { &backward, &forward })
+        for (const int ix : *pages) ranks.emplace_back(m_rank[static_cast<size_t>(ix)]);
+    std::sort(ranks.begin(), ranks.end());
+    size_t ixRank = 0;
+    for (const auto *pages : { &backward, &forward })
+        for (const int ix : *pages) m_rank[static_cast<size_t>(ix)] = ranks[ixRank++];
+}
+
+void topological_sorter::rank_pages()
+{
+    // Kahn's algorithm over the whole rule graph; the order pages leave
+    // the queue is their rank
+    const rule_index &rules = *m_rules;
+    const size_t cPages = rules.page_count();
+    std::vector<int> in_degree(cPages, 0);
+    for (size_t ixPage = 0; ixPage < cPages; ixPage++)
+        for (const int ixSuccessor : rules.successors(static_cast<int>(ixPage))) in_degree[static_cast<size_t>(ixSuccessor)]++;
+
+    std::vector<int> order {};
+    order.reserve(cPages);
+    for (size_t ixPage = 0; ixPage < cPages; ixPage++)
+        if (0 == in_degree[ixPage]) order.emplace_back(static_cast<int>(ixPage));
+    for (size_t ixOrder = 0; ixOrder < order.size(); ixOrder++)
+    {
+        for (const int ixSuccessor : rules.successors(order[ixOrder]))
+            if (0 == --in_degree[static_cast<size_t>(ixSuccessor)]) order.emplace_back(ixSuccessor);
+    }
+    m_has_order = order.size() == cPages;
+    m_rank.clear();
+    if (!m_has_order) return;
+
+    m_rank.assign(cPages, 0);
+    for (size_t ixOrder = 0; ixOrder < order.size(); ixOrder++)
+        m_rank[static_cast<size_t>(order[ixOrder])] = static_cast<int>(ixOrder);
+    m_min_rank = 0;
+    m_max_rank = static_cast<int>(cPages) - 1;
+}
+
+/// @brief Pairs every page of @p pages with its rank, looked up once.
+void topological_sorter::rank_slots(std::span<const int> pages)
+{
+    m_ranked.resize(pages.size());
+    for (size_t ixSlot = 0; ixSlot < pages.size(); ixSlot++)
+    {
+        // unconstrained pages can go anywhere; put them first
+        const int ix = m_rules->index_of(pages[ixSlot]);
+        const int rank = rule_index::NO_PAGE == ix ? std::numeric_limits<int>::min() : m_rank[static_cast<size_t>(ix)];
+        m_ranked[ixSlot] = { rank, pages[ixSlot] };
+    }
+}
+
+/// @brief Calls f(target) for every slot that the slot @p ixSlot must
+///        precede, once per edge; only valid between count_in_degrees and
+///        release_slots.
+template <typename F>
+void topological_sorter::for_each_induced_edge(int ixSlot, F &&f) const
+{
+    const int ix = m_indices[static_cast<size_t>(ixSlot)];
+    if (rule_index::NO_PAGE == ix) return;
+    for (const int ixSuccessor : m_rules->successors(ix))
+    {
+        for (int ixTarget = m_first_slot[static_cast<size_t>(ixSuccessor)];
+             NO_SLOT != ixTarget; ixTarget = m_next_slot[static_cast<size_t>(ixTarget)])
+            f(ixTarget);
+    }
+}
+
+/// @brief In-degree of every slot of @p pages in their induced subgraph.
+///        Slots of a repeated page are chained so an edge reaches them all.
+void topological_sorter::count_in_degrees(std::span<const int> pages)
+{
+    const size_t cSlots = pages.size();
+    m_indices.resize(cSlots);
+    m_next_slot.resize(cSlots);
+    m_in_degree.assign(cSlots, 0);
+    for (size_t ixSlot = cSlots; ixSlot-- > 0;)
+    {
+        const int ix = m_rules->index_of(pages[ixSlot]);
+        m_indices[ixSlot] = ix;
+        m_next_slot[ixSlot] = NO_SLOT;
+        if (rule_index::NO_PAGE == ix) continue;
+        m_next_slot[ixSlot] = m_first_slot[static_cast<size_t>(ix)];
+        m_first_slot[static_cast<size_t>(ix)] = static_cast<int>(ixSlot);
+    }
+
+    for (size_t ixSlot = 0; ixSlot < cSlots; ixSlot++)
+    {
+        for_each_induced_edge(static_cast<int>(ixSlot),
+            [&](int ixTarget) { m_in_degree[static_cast<size_t>(ixTarget)]++; });
+    }
+}
+
+void topological_sorter::release_slots()
+{
+    for (const int ix : m_indices)
+        if (rule_index::NO_PAGE != ix) m_first_slot[static_cast<size_t>(ix)] = NO_SLOT;
+}
+
+auto topological_sorter::sort(std::span<int> pages) -> bool
+{
+    if (has_global_order())
+    {
+        rank_slots(pages);
+        std::stable_sort(m_ranked.begin(), m_ranked.end(),
+            [](const auto &lhs, const auto &rhs) { return lhs.first < rhs.first; });
+        for (size_t ixSlot = 0; ixSlot < pages.size(); ixSlot++) pages[ixSlot] = m_ranked[ixSlot].second;
+        return true;
+    }
+
+    count_in_degrees(pages);
+    m_queue.clear();
+    for (size_t ixSlot = 0; ixSlot < pages.size(); ixSlot++)
+        if (0 == m_in_degree[ixSlot]) m_queue.emplace_back(static_cast<int>(ixSlot));
+    for (size_t ixQueue = 0; ixQueue < m_queue.size(); ixQueue++)
+    {
+        for_each_induced_edge(m_queue[ixQueue], [&](int ixTarget)
+            {
+                if (0 == --m_in_degree[static_cast<size_t>(ixTarget)]) m_queue.emplace_back(ixTarget);
+            });
+    }
+    release_slots();
+    if (m_queue.size() != pages.size()) return false;
+
+    // m_indices is free again, so it holds the sorted pages
+    for (size_t ixQueue = 0; ixQueue < m_queue.size(); ixQueue++)
+        m_indices[ixQueue] = pages[static_cast<size_t>(m_queue[ixQueue])];
+    std::copy_n(m_indices.begin(), pages.size(), pages.begin());
+    return true;
+}
+
+/// @brief middle() for dense rules, a bit row at a time: each page's
+///        in-degree is its predecessor row counted over the pages present,
+///        and the order is total when every page's predecessors are
+///        exactly the pages of lower in-degree.
+/// @return nullopt unless the rules order @p pages totally
+auto topological_sorter::middle_from_rows(std::span<const int> pages) -> std::optional<int>
+{
+    const size_t cWords = m_rules->row_words();
+    m_present.assign(cWords, 0);
+    m_indices.resize(pages.size());
+    for (size_t ixSlot = 0; ixSlot < pages.size(); ixSlot++)
+    {
+        const int ix = m_rules->index_of(pages[ixSlot]);
+        if (rule_index::NO_PAGE == ix) return std::nullopt;
+        const auto bit = static_cast<size_t>(ix);
+        const uint64_t mask = uint64_t { 1 } << (bit % 64);
+        // a repeated page cannot be totally ordered
+        if (0 != (m_present[bit / 64] & mask)) return std::nullopt;
+        m_present[bit / 64] |= mask;
+        m_indices[ixSlot] = ix;
+    }
+
+    // slot of each in-degree
+    m_queue.assign(pages.size(), NO_SLOT);
+    for (size_t ixSlot = 0; ixSlot < pages.size(); ixSlot++)
+    {
+        const auto predecessors = m_rules->predecessor_row(m_indices[ixSlot]);
+        size_t in_degree = 0;
+        for (size_t ixWord = 0; ixWord < cWords; ixWord++)
+            in_degree += static_cast<size_t>(std::popcount(predecessors[ixWord] & m_present[ixWord]));
+        if (in_degree >= pages.size() || NO_SLOT != m_queue[in_degree]) return std::nullopt;
+        m_queue[in_degree] = static_cast<int>(ixSlot);
+    }
+
+    m_prefix.assign(cWords, 0);
+    for (const int ixSlot : m_queue)
+    {
+        const int ix = m_indices[static_cast<size_t>(ixSlot)];
+        const auto predecessors = m_rules->predecessor_row(ix);
+        for (size_t ixWord = 0; ixWord < cWords; ixWord++)
+            if ((predecessors[ixWord] & m_present[ixWord]) != m_prefix[ixWord]) return std::nullopt;
+        const auto bit = static_cast<size_t>(ix);
+        m_prefix[bit / 64] |= uint64_t { 1 } << (bit % 64);
+    }
+    return pages[static_cast<size_t>(m_queue[(pages.size() - 1) / 2])];
+}
+
+auto topological_sorter::middle(std::span<int> pages) -> std::optional<int>
+{
+    if (pages.empty()) return std::nullopt;
+    const size_t ixMid = (pages.size() - 1) / 2;
+    if (has_global_order())
+    {
+        rank_slots(pages);
+        std::nth_element(m_ranked.begin(), m_ranked.begin() + static_cast<ptrdiff_t>(ixMid), m_ranked.end(),
+            [](const auto &lhs, const auto &rhs) { return lhs.first < rhs.first; });
+        return m_ranked[ixMid].second;
+    }
+
+    if (m_rules->prefers_rows())
+    {
+        if (const auto ret = middle_from_rows(pages)) return ret;
+        if (!sort(pages)) return std::nullopt;
+        return pages[ixMid];
+    }
+
+    // totally ordered pages have in-degrees 0..k-1, one each, with every
+    // edge going up in degree; the middle page is then the one with ixMid
+    // predecessors. Mutual rules can fake the degrees, hence the edge check
+    count_in_degrees(pages);
+    m_queue.assign(pages.size(), 0);
+    std::optional<int> ret {};
+    bool total = true;
+    for (size_t ixSlot = 0; ixSlot < pages.size() && total; ixSlot++)
+    {
+        const auto in_degree = static_cast<size_t>(m_in_degree[ixSlot]);
+        total = in_degree < pages.size() && 0 == m_queue[in_degree]++;
+        if (ixMid == in_degree) ret = pages[ixSlot];
+    }
+    for (size_t ixSlot = 0; ixSlot < pages.size() && total; ixSlot++)
+    {
+        for_each_induced_edge(static_cast<int>(ixSlot), [&](int ixTarget)
+            {
+                total &= m_in_degree[ixSlot] < m_in_degree[static_cast<size_t>(ixTarget)];
+            });
+    }
+    release_slots();
+    if (total) return ret;
+
+    if (!sort(pages)) return std::nullopt;
+    return pages[ixMid];
+}
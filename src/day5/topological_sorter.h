@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "rule_index.h"
+
+/// @brief Orders the pages of an update so every rule between them holds.
+///        When the whole rule graph is acyclic every page gets a global
+///        rank up front and an update is ordered by rank. Otherwise each
+///        update's induced subgraph goes through Kahn's algorithm, which
+///        also finds the updates whose rules form a cycle. Pages no rule
+///        mentions are unconstrained and keep their relative order.
+class topological_sorter
+{
+public:
+    explicit topological_sorter(const rule_index &rules);
+
+    /// @brief Takes in a rule just added to the index. The ranks are only
+    ///        touched when the rule runs against them, and then only
+    ///        between its two pages.
+    void add_rule(int ixLhs, int ixRhs);
+
+    /// @brief Whether the rule graph is acyclic, so ranks are used.
+    auto has_global_order() const -> bool { return m_has_order; }
+
+    /// @brief Sorts @p pages in place.
+    /// @return false, leaving @p pages untouched, if their rules form a cycle
+    auto sort(std::span<int> pages) -> bool;
+
+    /// @brief The page that sort() would put in the middle of @p pages,
+    ///        which may be reordered on the way. Avoids a full sort where
+    ///        it can: by rank with nth_element, or straight from the
+    ///        in-degrees when the rules order the pages totally.
+    /// @return nullopt if the rules among @p pages form a cycle
+    auto middle(std::span<int> pages) -> std::optional<int>;
+
+private:
+    auto middle_from_rows(std::span<const int> pages) -> std::optional<int>;
+    void count_in_degrees(std::span<const int> pages);
+    template <typename F>
+    void for_each_induced_edge(int ixSlot, F &&f) const;
+    void release_slots();
+    void rank_slots(std::span<const int> pages);
+    void rank_pages();
+    void rerank(int ixLhs, int ixRhs);
+
+    const rule_index *m_rules;
+    bool m_has_order = false;
+    std::vector<int> m_rank;
+    int m_min_rank = 0;
+    int m_max_rank = -1;
+    // per-update scratch, sized for the rule set once and reset after use
+    std::vector<int> m_first_slot;
+    std::vector<int> m_indices;
+    std::vector<int> m_next_slot;
+    std::vector<int> m_in_degree;
+    std::vector<int> m_queue;
+    std::vector<std::pair<int, int>> m_ranked;
+    std::vector<uint64_t> m_present;
+    std::vector<uint64_t> m_prefix;
+};
@@ -1,11 +1,26 @@
+#include "day6.h"
 #include "assert.h"
 #include <algorithm>
-#include <fstream>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <filesystem>
 #include <iostream>
+#include <iterator>
+#include <numeric>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "input_cache.h"
+#include "mapped_file.h"
+#include "text_scan.h"
+#include "thread_pool.h"
+
+namespace day6
+{
+
 struct Vec2
 {
   int x, y;
@@ -19,14 +34,19 @@ public:
   static constexpr char DIR_DOWN  = 'v';
   static constexpr char DIR_LEFT  = '<';
 
-  enum class direction
+  /// @brief Headings in clockwise order, so a right turn is the next one.
+  enum class direction : uint8_t
   {
     up,
+    right,
     down,
-    left,
-    right
+    left
   };
 
+  /// @brief Row and column offset of one step, indexed by direction.
+  static constexpr std::array<int, 4> DELTA_ROW{ -1, 0, 1, 0 };
+  static constexpr std::array<int, 4> DELTA_COL{ 0, 1, 0, -1 };
+
   character(int position, char cur) :
     m_position(position),
     m_dir(direction::up)
@@ -41,229 +61,555 @@ public:
     };
   }
 
-  void turn_right()
-  {
-    switch (m_dir)
-    {
-    case direction::up:    m_dir = direction::right; break;
-    case direction::down:  m_dir = direction::left;  break;
-    case direction::left:  m_dir = direction::up;    break;
-    case direction::right: m_dir = direction::down;  break;
-    }
-  }
+  void turn_right() { m_dir = turned(m_dir); }
 
   static auto is_character(char c) -> bool 
   { 
     return c == DIR_UP || c == DIR_RIGHT || c == DIR_DOWN || c == DIR_LEFT;
   }
 
+  /// @brief Dense 0..3 index of @p dir, for per-direction tables.
+  static constexpr auto index(direction dir) -> size_t { return static_cast<size_t>(dir); }
+
+  static constexpr auto turned(direction dir) -> direction
+  {
+    return static_cast<direction>((index(dir) + 1) & 3);
+  }
+
+  /// @brief Offset of one step heading @p dir in a map @p cCols wide.
+  static constexpr auto stride(direction dir, int cCols) -> int
+  {
+    return DELTA_ROW[index(dir)] * cCols + DELTA_COL[index(dir)];
+  }
+
   auto get_direction() const -> direction { return m_dir; }
   auto get_position() const -> int { return m_position; }
   auto set_position(int pos) { m_position = pos; }
+  void set_direction(direction dir) { m_dir = dir; }
 private:
   int m_position;
   direction m_dir;
 };
 
+/// @brief The headings the guard has passed each cell with, one bit per
+///        heading and 16 cells to a word. It lives apart from the map, so
+///        the map stays read-only and any number of walks can share it.
+class visit_map
+{
+public:
+  explicit visit_map(int cCells) :
+    m_words((static_cast<size_t>(cCells) * 4 + 63) / 64, 0) {}
+
+  /// @brief Records @p dir at @p cell.
+  /// @return false if it was already recorded
+  auto mark(int cell, character::direction dir) -> bool
+  {
+    const size_t bit = static_cast<size_t>(cell) * 4 + character::index(dir);
+    uint64_t &word = m_words[bit / 64];
+    const uint64_t mask = uint64_t{ 1 } << (bit % 64);
+    const bool fresh = 0 == (word & mask);
+    word |= mask;
+    return fresh;
+  }
+
+  auto visited(int cell) const -> bool
+  {
+    const size_t bit = static_cast<size_t>(cell) * 4;
+    return 0 != ((m_words[bit / 64] >> (bit % 64)) & 0xF);
+  }
+
+  /// @brief Forgets every heading of @p cell.
+  void clear(int cell)
+  {
+    const size_t bit = static_cast<size_t>(cell) * 4;
+    m_words[bit / 64] &= ~(uint64_t{ 0xF } << (bit % 64));
+  }
+
+  /// @brief Cells visited with any heading: each cell's four bits fold
+  ///        into its lowest, then a popcount per word.
+  auto visited_count() const -> int
+  {
+    constexpr uint64_t LOW_BITS = 0x1111111111111111ull;
+    int ret = 0;
+    for (const uint64_t word : m_words)
+      ret += std::popcount((word | word >> 1 | word >> 2 | word >> 3) & LOW_BITS);
+    return ret;
+  }
+
+private:
+  std::vector<uint64_t> m_words;
+};
+
 struct map_grid
 {
 public:
-  static constexpr char VISITED_UD     = '|';
-  static constexpr char VISITED_LR     = '-';
-  static constexpr char VISITED_INT    = '+';
-  static constexpr char NOT_VISITED    = '.';
   static constexpr char OBSTACLE       = '#';
   static constexpr char GRID_DELIMITER = '\n';
 
-  map_grid(std::string &&map, int cCols) :
-    m_map(std::move(map)),
-    m_dimensions{ cCols, static_cast<int>(map.length()) / cCols } {}
+  map_grid(std::string_view map, int cCols) :
+    m_dimensions{ cCols, static_cast<int>(map.length()) / cCols },
+    m_map(map) {}
 
-  character extract_character() const
+  /// @brief The guard, or nothing for a map without one.
+  std::optional<character> extract_character() const
   {
     const auto it = 
       std::find_if(m_map.begin(), m_map.end(), character::is_character);
-    assert(it != m_map.end());
+    if (it == m_map.end()) return std::nullopt;
     const size_t pos = std::distance(m_map.begin(), it);
     return character{ static_cast<int>(pos), *it };
   }
 
-  template <typename F>
-  void trace_character(character &cur, bool leave_trace, F &&f)
+  /// @brief Walks the guard cell by cell until it leaves the map, marking
+  ///        every cell and heading it passes in @p visits. Coming back to
+  ///        a marked one means a loop.
+  /// @return false if the guard walks in a loop
+  auto trace_character(character cur, visit_map &visits) const -> bool
   {
-    while (true)
+    const int cCols = m_dimensions.x;
+    const auto cCells = static_cast<unsigned>(m_map.length());
+    std::array<int, 4> strides{};
+    for (size_t ix = 0; ix < strides.size(); ix++)
+      strides[ix] = character::stride(static_cast<character::direction>(ix), cCols);
+
+    character::direction dir = cur.get_direction();
+    int position = cur.get_position();
+    int col = position % cCols;
+    while (visits.mark(position, dir))
     {
-      const character::direction dir = cur.get_direction();
-      const int jump = [&]() -> int
-        {
-          switch (dir)
-          {
-          case character::direction::left:  return  -1;
-          case character::direction::right: return   1;
-          case character::direction::up:    return -m_dimensions.x;
-          case character::direction::down:  return  m_dimensions.x;
-          }
-        }();
-
-      const int position = cur.get_position();
-      const int destination = position + jump;
-      
-      f(m_map[position]);
-
-      if (leave_trace)
+      const size_t ixDir = character::index(dir);
+      const int destination = position + strides[ixDir];
+      const int destCol = col + character::DELTA_COL[ixDir];
+      // off the top or bottom wraps past cCells as unsigned, and off either
+      // side leaves the column range
+      if (static_cast<unsigned>(destination) >= cCells ||
+          static_cast<unsigned>(destCol) >= static_cast<unsigned>(cCols))
       {
-        if (NOT_VISITED == m_map[position])
-        {
-          switch (dir)
-          {
-          case character::direction::left:  m_map[position] = VISITED_LR; break;
-          case character::direction::right: m_map[position] = VISITED_LR; break;
-          case character::direction::up:    m_map[position] = VISITED_UD; break;
-          case character::direction::down:  m_map[position] = VISITED_UD; break;
-          }
-        }
-
-        if (VISITED_LR == m_map[position])
-        {
-          switch (dir)
-          {
-          case character::direction::up:    m_map[position] = VISITED_INT; break;
-          case character::direction::down:  m_map[position] = VISITED_INT; break;
-          default: break;
-          }
-        }
-
-        if (VISITED_UD == m_map[position])
-        {
-          switch (dir)
-          {
-          case character::direction::left:    m_map[position] = VISITED_INT; break;
-          case character::direction::right:   m_map[position] = VISITED_INT; break;
-          default: break;
-          }
-        }
-
-        // case if go off map vertically or horizontally at very beginning / end.
-        if (destination < 0 || destination >= static_cast<int>(m_map.length()))
-        {
-          break;
-        }
-
-        // case if go left off map boundary
-        if (0 == (position % m_dimensions.x) &&
-            character::direction::left == dir)
-        {
-          break;
-        }
-
-        // case if go right off map boundary
-        if (0 == ((position + 1) % m_dimensions.x) &&
-            character::direction::right == dir)
-        {
-          break;
-        }
+        return true;
       }
 
-      if (OBSTACLE == m_map[destination])
-      { // case if hit obstacle (turn right)
-        cur.turn_right();
+      if (OBSTACLE == m_map[static_cast<size_t>(destination)])
+      {
+        dir = character::turned(dir);
       }
-      else 
-      { // case if can move to destination
-        cur.set_position(destination);
+      else
+      {
+        position = destination;
+        col = destCol;
       }
     }
+    return false;
   }
 
-  static auto is_visit_not_start(char c) -> bool 
+  auto buf() const -> std::string_view { return m_map; }
+  auto cols() const -> int { return m_dimensions.x; }
+  auto cells() const -> int { return static_cast<int>(m_map.length()); }
+private:
+  Vec2 m_dimensions{};
+  std::string_view m_map;
+};
+
+/// @brief Any number of maps laid end to end in one buffer. Each map's rows
+///        are joined without their line breaks, so its cell (row, col) is
+///        at row * cols + col from the start of the map.
+class map_arena
+{
+public:
+  void reserve(size_t cBytes) { m_cells.reserve(cBytes); }
+
+  /// @brief Appends every map in @p text, where maps are separated by blank
+  ///        lines. The first is called @p name and any more name:1, name:2..,
+  ///        or with no name each is called by its index in the arena.
+  void append(std::string_view text, const std::string &name)
   {
-    return VISITED_LR == c || VISITED_UD == c || VISITED_INT == c;
+    size_t cInText = 0;
+    size_t offset = m_cells.size();
+    size_t cCols = 0;
+    const auto close_map = [&]()
+      {
+        if (0 == cCols) return;
+        std::string mapName = name.empty() ? std::to_string(m_maps.size()) :
+          0 == cInText ? name : name + ':' + std::to_string(cInText);
+        m_maps.push_back({ offset, m_cells.size() - offset, static_cast<int>(cCols),
+                           std::move(mapName) });
+        cInText++;
+        offset = m_cells.size();
+        cCols = 0;
+      };
+
+    for (const std::string_view line : lines(text))
+    {
+      if (line.empty())
+      {
+        close_map();
+        continue;
+      }
+      m_cells.append(line);
+      cCols = line.length();
+    }
+    close_map();
   }
 
-  auto visited_count() const -> int
+  auto size() const -> size_t { return m_maps.size(); }
+  auto cells(size_t ix) const -> size_t { return m_maps[ix].cCells; }
+  auto name(size_t ix) const -> const std::string& { return m_maps[ix].name; }
+
+  /// @brief Map @p ix, a view that stays valid while the arena lives and
+  ///        nothing more is appended.
+  auto map(size_t ix) const -> map_grid
   {
-    return std::count_if(m_map.begin(), m_map.end(), [&](char c)
-      {
-        return is_visit_not_start(c) || character::is_character(c);
-      });
+    const entry &e = m_maps[ix];
+    return map_grid{ std::string_view{ m_cells }.substr(e.offset, e.cCells), e.cCols };
   }
 
-  auto buf() const -> const std::string& { return m_map; }
 private:
-  Vec2 m_dimensions{};
-  std::string m_map;
+  struct entry
+  {
+    size_t offset;
+    size_t cCells;
+    int cCols;
+    std::string name;
+  };
+
+  std::string m_cells;
+  std::vector<entry> m_maps;
+};
+
+/// @brief For every free cell and heading, where the guard next stops:
+///        the last cell before the next obstacle ahead. A guard that would
+///        walk off the map instead gets ~edge, the complement of the last
+///        cell it stands on, so any negative stop means it leaves.
+///        Built once per map, this lets a walk go from turn to turn in O(1)
+///        per turn instead of one cell at a time.
+class jump_table
+{
+public:
+  static constexpr int NO_OBSTACLE = -1;
+
+  jump_table(std::string_view map, int cCols) :
+    m_cCols(cCols)
+  {
+    const int cCells = static_cast<int>(map.length());
+    const int cRows = cCells / cCols;
+    for (auto &stops : m_stops) stops.assign(map.length(), 0);
+
+    // one sweep per direction, against the direction of travel, carrying
+    // the stop of the cell just behind
+    for (int ixRow = 0; ixRow < cRows; ixRow++)
+    {
+      const int first = ixRow * cCols, last = first + cCols - 1;
+      sweep(map, character::direction::right, last, first - 1, -1);
+      sweep(map, character::direction::left, first, last + 1, 1);
+    }
+    for (int ixCol = 0; ixCol < cCols; ixCol++)
+    {
+      const int first = ixCol, last = ixCol + (cRows - 1) * cCols;
+      sweep(map, character::direction::down, last, first - cCols, -cCols);
+      sweep(map, character::direction::up, first, last + cCols, cCols);
+    }
+  }
+
+  auto stop(int position, character::direction dir) const -> int
+  {
+    return m_stops[character::index(dir)][static_cast<size_t>(position)];
+  }
+
+  /// @brief stop() with one more obstacle at @p extra, which only matters
+  ///        if it lies on the way from @p position to the stop.
+  auto stop(int position, character::direction dir, int extra) const -> int
+  {
+    const int next = stop(position, dir);
+    if (NO_OBSTACLE == extra) return next;
+
+    const int end = leaves_map(next) ? ~next : next;
+    const int step = step_of(dir);
+    const bool same_line = 1 == step || -1 == step ?
+      extra / m_cCols == position / m_cCols : extra % m_cCols == position % m_cCols;
+    // extra - position runs the same way as step and no further than end
+    const int ahead = (extra - position) * (step < 0 ? -1 : 1);
+    const int reach = (end - position) * (step < 0 ? -1 : 1);
+    if (!same_line || ahead <= 0 || ahead > reach) return next;
+    return extra - step;
+  }
+
+  /// @brief Offset of one cell in direction @p dir.
+  auto step_of(character::direction dir) const -> int
+  {
+    return character::stride(dir, m_cCols);
+  }
+
+  static auto leaves_map(int stop) -> bool { return stop < 0; }
+
+private:
+  /// @brief Fills the stops of one line for guards heading @p dir, walking
+  ///        from the cell at the far end, @p from, back to @p end.
+  void sweep(std::string_view map, character::direction dir, int from, int end, int step)
+  {
+    auto &stops = m_stops[character::index(dir)];
+    int next = ~from;
+    for (int position = from; position != end; position += step)
+    {
+      stops[static_cast<size_t>(position)] = next;
+      // a guard behind an obstacle stops on the cell behind it
+      if (map_grid::OBSTACLE == map[static_cast<size_t>(position)]) next = position + step;
+    }
+  }
+
+  int m_cCols;
+  std::array<std::vector<int>, 4> m_stops;
 };
 
-auto parse_file(const char *filename) -> 
-  std::optional<std::pair<character, map_grid>>
+/// @brief Reads the maps in @p path into @p arena: every regular file of a
+///        directory, in name order and named after the file, or else the
+///        file itself, or stdin for "-", named by their position.
+auto read_maps(const char *path, map_arena &arena) -> bool
 {
-  std::ifstream input_file{ filename };
-  if (input_file.fail()) { return std::nullopt; }
-  
-  input_file.seekg(0, std::ios::end);
-  const size_t cBytes = input_file.tellg();
-  input_file.seekg(0);
-  std::string map_bytes;
-  map_bytes.reserve(cBytes);
-
-  std::string line;
-  size_t cColumnLength = 0;
-  for (std::string line; std::getline(input_file, line); )
-  {
-    map_bytes.append(line);
-    cColumnLength = line.length();
+  if (std::string_view("-") == path)
+  {
+    const std::string text{ std::istreambuf_iterator<char>(std::cin), {} };
+    arena.reserve(text.size());
+    arena.append(text, {});
+    return true;
+  }
+
+  std::error_code ec{};
+  if (!std::filesystem::is_directory(path, ec))
+  {
+    const auto input_file = input_cache::open(path);
+    if (!input_file->is_open()) return false;
+    arena.reserve(input_file->size());
+    arena.append(input_file->view(), {});
+    return true;
+  }
+
+  std::vector<std::filesystem::path> files{};
+  size_t cBytes = 0;
+  for (const auto &entry : std::filesystem::directory_iterator(path, ec))
+  {
+    if (!entry.is_regular_file(ec)) continue;
+    files.push_back(entry.path());
+    cBytes += entry.file_size(ec);
+  }
+  std::sort(files.begin(), files.end());
+
+  arena.reserve(cBytes);
+  for (const auto &file : files)
+  {
+    const mapped_file input_file{ file.string().c_str() };
+    if (!input_file.is_open()) continue;
+    arena.append(input_file.view(), file.filename().string());
   }
+  return true;
+}
+
+/// @brief Cells the guard visits before leaving the map, 0 if it never does.
+auto count_visited(const map_grid &map) -> int
+{
+  const auto cur = map.extract_character();
+  if (false == cur.has_value()) return 0;
 
-  assert(0 != cColumnLength);
-  map_grid map{ std::move(map_bytes), static_cast<int>(cColumnLength) };
-  character cur = map.extract_character();
-  return std::make_pair(cur, std::move(map));
+  visit_map visits{ map.cells() };
+  if (!map.trace_character(*cur, visits)) return 0;
+  return visits.visited_count();
 }
 
-auto puzzle1(const char *filename) -> int
+/// @brief A cell of the guard's path where an obstacle could go, with the
+///        guard's state just before it first steps onto that cell.
+struct placement
+{
+  int cell;
+  int from;
+  character::direction dir;
+};
+
+/// @brief Walks the guard's path once, segment by segment, and returns
+///        every cell it reaches other than its start, each with the state
+///        it first arrives from. Empty if the guard never leaves.
+auto path_placements(const character &start, const jump_table &jumps, int cCells)
+  -> std::vector<placement>
+{
+  std::vector<placement> ret{};
+  visit_map seen{ cCells };
+  seen.mark(start.get_position(), start.get_direction());
+  character cur = start;
+  for (int64_t cTurns = 0; cTurns <= int64_t{ 4 } * cCells; cTurns++)
+  {
+    const character::direction dir = cur.get_direction();
+    const int step = jumps.step_of(dir);
+    const int next = jumps.stop(cur.get_position(), dir);
+    const int end = jump_table::leaves_map(next) ? ~next : next;
+    for (int position = cur.get_position(); position != end; position += step)
+    {
+      const int cell = position + step;
+      if (seen.visited(cell)) continue;
+      seen.mark(cell, dir);
+      ret.push_back({ cell, position, dir });
+    }
+    if (jump_table::leaves_map(next)) return ret;
+    cur.set_position(next);
+    cur.turn_right();
+  }
+  return {};
+}
+
+/// @brief Whether the guard, starting from @p cur with one more obstacle at
+///        @p extra, ends up walking in a loop. Its turns are marked in
+///        @p turns; the cells it marks are listed in @p touched and cleared
+///        again before returning, so one pair of buffers serves any number
+///        of calls.
+auto loops_with(character cur, const jump_table &jumps, int extra,
+                visit_map &turns, std::vector<int> &touched) -> bool
+{
+  bool loops = false;
+  while (true)
+  {
+    const int next = jumps.stop(cur.get_position(), cur.get_direction(), extra);
+    if (jump_table::leaves_map(next)) break;
+    cur.set_position(next);
+    cur.turn_right();
+    if (!turns.mark(next, cur.get_direction()))
+    {
+      loops = true;
+      break;
+    }
+    touched.emplace_back(next);
+  }
+
+  for (const int cell : touched) turns.clear(cell);
+  touched.clear();
+  return loops;
+}
+
+constexpr size_t CHUNKS_PER_THREAD = 4;
+
+/// @brief Counts the cells where one more obstacle traps the guard in a
+///        loop. Only cells on the guard's path can change its walk, and
+///        each is tried from the state just before the guard first reaches
+///        it, since the walk up to there is unchanged. Candidates are split
+///        into up to @p cChunks chunks; each chunk sets up its buffers once.
+auto count_loop_obstacles(const map_grid &map, thread_pool &pool, size_t cChunks) -> int
 {
-  auto cur_map = parse_file(filename);
-  if (false == cur_map.has_value()) return 0;
-  auto &[cur, map] = *cur_map;
-  int sum = 0;
-  map.trace_character(cur, true, [&](char c)
+  const auto cur = map.extract_character();
+  if (false == cur.has_value()) return 0;
+
+  const jump_table jumps{ map.buf(), map.cols() };
+  const auto placements = path_placements(*cur, jumps, map.cells());
+
+  cChunks = std::min(placements.size(), cChunks);
+  return parallel_reduce(pool, cChunks, 0, [&](size_t ix)
     {
-      sum += static_cast<int>(map_grid::NOT_VISITED == c);
+      visit_map turns{ map.cells() };
+      std::vector<int> touched{};
+      int sum = 0;
+      const auto [first, last] = task_range(placements.size(), cChunks, ix);
+      for (size_t ixPlacement = first; ixPlacement < last; ixPlacement++)
+      {
+        const auto &[cell, from, dir] = placements[ixPlacement];
+        character guard = *cur;
+        guard.set_position(from);
+        guard.set_direction(dir);
+        sum += static_cast<int>(loops_with(guard, jumps, cell, turns, touched));
+      }
+      return sum;
     });
-  return sum + 1;
 }
 
-auto puzzle2(const char *filename) -> int
+auto puzzle1(const char *filename) -> int
 {
-  auto cur_map = parse_file(filename);
-  if (false == cur_map.has_value()) return 0;
-  auto &[cur, map] = *cur_map;
-  //map.trace_character(cur);
-  //const auto &map_buf = map.buf();
-  //for (const auto c : map_buf)
-  //{
-  //  // can only process points on path
-  //  if (false == map_grid::is_visit_not_start(c)) continue;
-
-  //}
+  map_arena arena{};
+  if (!read_maps(filename, arena) || 0 == arena.size()) return 0;
+  return count_visited(arena.map(0));
+}
+
+auto puzzle2(const char *filename, thread_pool &pool) -> int
+{
+  map_arena arena{};
+  if (!read_maps(filename, arena) || 0 == arena.size()) return 0;
+  return count_loop_obstacles(arena.map(0), pool, pool.size() * CHUNKS_PER_THREAD);
+}
+
+/// @brief Solves both puzzles for every map in @p path (see read_maps) and
+///        prints "<name> <puzzle1> <puzzle2>" per map, in input order. Maps
+///        are handed to the pool largest first, and idle threads claim the
+///        next one as they finish, so a few big maps do not leave the rest
+///        of the pool waiting at the end. When there are fewer maps than
+///        threads, each map's obstacle search is split up as well.
+auto batch(const char *path, thread_pool &pool) -> int
+{
+  map_arena arena{};
+  if (!read_maps(path, arena))
+  {
+    std::cout << "Cannot read " << path << '\n';
+    return 1;
+  }
+
+  std::vector<size_t> order(arena.size());
+  std::iota(order.begin(), order.end(), size_t{ 0 });
+  std::stable_sort(order.begin(), order.end(),
+    [&](size_t a, size_t b) { return arena.cells(a) > arena.cells(b); });
+
+  const size_t cChunks = arena.size() >= pool.size() ? 1 : pool.size() * CHUNKS_PER_THREAD;
+  std::vector<std::pair<int, int>> results(arena.size());
+  pool.parallel_for(order.size(), [&](size_t ix)
+    {
+      const size_t ixMap = order[ix];
+      const map_grid map = arena.map(ixMap);
+      results[ixMap] = { count_visited(map), count_loop_obstacles(map, pool, cChunks) };
+    });
 
+  std::string out{};
+  for (size_t ixMap = 0; ixMap < arena.size(); ixMap++)
+  {
+    const auto &[visited, obstacles] = results[ixMap];
+    out += arena.name(ixMap);
+    out += ' ';
+    out += std::to_string(visited);
+    out += ' ';
+    out += std::to_string(obstacles);
+    out += '\n';
+  }
+  std::cout << out;
   return 0;
 }
 
-int main(int argc, char *argv[])
+auto part1(const char *filename, thread_pool &) -> int64_t
+{
+  return puzzle1(filename);
+}
+
+auto part2(const char *filename, thread_pool &pool) -> int64_t
 {
+  return puzzle2(filename, pool);
+}
+
+auto run(int argc, char *argv[]) -> int
+{
+  // -j N: worker threads, 0 for one per core
+  size_t cThreads = 1;
+  if (argc > 3 && std::string_view("-j") == argv[1])
+  {
+    cThreads = to_int<size_t>(argv[2]);
+    argc -= 2;
+    argv += 2;
+  }
+  thread_pool pool{ cThreads };
+
   if (3 != argc)
   {
     std::cout << "Incorrect number of argumnets";
     return 1;
   }
+  else if (std::string_view("batch") == argv[1])
+  {
+    return batch(argv[2], pool);
+  }
   else if ('1' == argv[1][0])
   {
     std::cout << puzzle1(argv[2]) << '\n';
   }
   else if ('2' == argv[1][0])
   {
-    std::cout << puzzle2(argv[2]) << '\n';
+    std::cout << puzzle2(argv[2], pool) << '\n';
   }
   else
   {
@@ -273,3 +619,5 @@ int main(int argc, char *argv[])
 
   return 0;
 }
+
+} // namespace day6
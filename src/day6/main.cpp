@@ -0,0 +1,6 @@
+#include "day6.h"
+
+int main(int argc, char *argv[])
+{
+  return day6::run(argc, argv);
+}